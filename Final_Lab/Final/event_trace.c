@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+// Header file
+#include "event_trace.h"
+// Rings come from the SRAM arena
+#include "mem_arena.h"
+
+struct trace_rec {
+  unsigned int t ;
+  unsigned char type ;
+  unsigned char core ;
+  unsigned short arg ;
+} ;
+
+static struct trace_rec * trace_ring[2] ;
+static volatile unsigned int trace_head[2] ;
+static volatile int trace_on ;
+
+void trace_init(void)
+{
+  for (int core = 0; core<2; core++) {
+    trace_ring[core] = arena_alloc(ARENA_MAIN, TRACE_RING*sizeof(struct trace_rec), 4, "trace ring") ;
+  }
+  trace_on = 1 ;
+}
+
+void trace_event(int type, int arg)
+{
+  if (!trace_on) return ;
+  unsigned int core = get_core_num() ;
+  unsigned int head = trace_head[core] ;
+  struct trace_rec * r = &trace_ring[core][head % TRACE_RING] ;
+  r->t = timer_hw->timerawl ;
+  r->type = type ;
+  r->core = core ;
+  r->arg = arg ;
+  trace_head[core] = head + 1 ;
+}
+
+void trace_pause(int paused)
+{
+  trace_on = !paused ;
+}
+
+void trace_reset(void)
+{
+  trace_head[0] = trace_head[1] = 0 ;
+}
+
+int trace_dump_line(char * buf, int i)
+{
+  for (int core = 0; core<2; core++) {
+    unsigned int head = trace_head[core] ;
+    int n = head < TRACE_RING ? head : TRACE_RING ;
+    if (i < n) {
+      struct trace_rec * r = &trace_ring[core][(head - n + i) % TRACE_RING] ;
+      sprintf(buf, "ev %d %d %d %u\n\r", r->core, r->type, r->arg, r->t) ;
+      return 1 ;
+    }
+    i -= n ;
+  }
+  return 0 ;
+}
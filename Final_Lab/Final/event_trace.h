@@ -0,0 +1,49 @@
+/**
+ * Event tracer for both cores
+ *
+ * TRACE(type, arg) stamps an event with the 1 MHz timer into a ring
+ * per core (each core only writes its own, so no locking). The
+ * scheduler traces every thread call, the animation threads their
+ * frames and barrier waits, and the serial output its DMA transfers.
+ * The rings are dumped as text over serial ('e' key) and turned into
+ * a Chrome/Perfetto trace with tools/trace_to_json.py.
+ *
+ * DUMP FORMAT (one record per line)
+ *  - trace begin
+ *  - thread <core> <index> <name>
+ *  - ev <core> <type> <arg> <time us, 32 bit>   (oldest first)
+ *  - trace end
+ *
+ * With EVENT_TRACE 0 the hooks compile to nothing.
+ *
+ * NOTE
+ *  - trace_init() from core 0 before core 1 is launched (it allocates
+ *    from the arena)
+ */
+
+#define EVENT_TRACE 0
+// events kept per core
+#define TRACE_RING 1024
+
+enum trace_type {EV_THREAD_ENTER, EV_THREAD_EXIT, EV_FRAME_BEGIN, EV_FRAME_END,
+                 EV_WAIT_BEGIN, EV_WAIT_END, EV_DMA_START} ;
+
+#if EVENT_TRACE
+#define TRACE(type, arg) trace_event(type, arg)
+// hooks used by the protothreads scheduler
+#define PT_TRACE_ENTER(num) trace_event(EV_THREAD_ENTER, num)
+#define PT_TRACE_EXIT(num) trace_event(EV_THREAD_EXIT, num)
+#define PT_TRACE_DMA(chan) trace_event(EV_DMA_START, chan)
+#else
+#define TRACE(type, arg)
+#endif
+
+// Event tracer - usable in main
+void trace_init(void) ;
+void trace_event(int type, int arg) ;
+// stop or resume recording (stop while dumping)
+void trace_pause(int paused) ;
+// forget everything recorded so far
+void trace_reset(void) ;
+// event line i of the dump into buf, 0 past the last event
+int trace_dump_line(char * buf, int i) ;
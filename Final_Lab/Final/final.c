@@ -22,6 +22,16 @@
 
 // Include the VGA grahics library
 #include "vga_graphics.h"
+// Include the SRAM arena
+#include "mem_arena.h"
+// Include the binary command protocol
+#include "serial_cmd.h"
+// Include the framebuffer capture encoder
+#include "frame_capture.h"
+// Include the per-stage timing
+#include "stage_timing.h"
+// Include the event tracer (before protothreads, which uses its hooks)
+#include "event_trace.h"
 // Include standard libraries
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,11 +41,13 @@
 #include "pico/stdlib.h"
 #include "pico/divider.h"
 #include "pico/multicore.h"
+#include "pico/stdio_usb.h"
 // Include hardware libraries
 #include "hardware/pio.h"
 #include "hardware/dma.h"
 #include "hardware/clocks.h"
 #include "hardware/pll.h"
+#include "hardware/irq.h"
 // Include protothreads
 #include "pt_cornell_rp2040_v1.h"
 
@@ -68,12 +80,34 @@ typedef signed short fix5 ;
 
 // uS per frame
 #define FRAME_RATE 33000
+// 1 to start each frame on every FRAME_VBLANKS-th display refresh
+// (vga_frame_count) instead of FRAME_RATE after the last one began,
+// so the frame rate locks to the display's 59.5 Hz
+#define VBLANK_PACING 0
+#define FRAME_VBLANKS 2
+
+// text at the top left of the screen ends above this line
+// (particles are never drawn or cleared over it)
+#define HUD_BOTTOM 136
+
+// the stairs: three white 120x120 steps down to the bottom right
+// corner. stairLeft gives their left edge on row y (640 above them);
+// the physics tests the same faces in its own fix5 numbers.
+static inline int stairLeft(int y)
+{
+  return (y >= 360) ? 280 : (y >= 240) ? 400 : (y >= 120) ? 520 : 640 ;
+}
+
+static void drawStairs(void)
+{
+  for (int y = 120; y<480; y += 120) fillRect(stairLeft(y), y, 640 - stairLeft(y), 120, WHITE) ;
+}
 
 // the color of the boid
 char color = BLUE ;
 
-// number of boids
-#define NUM_BOIDS 10000
+// number of boids at boot (can be changed over serial, up to max_boids)
+#define INIT_BOIDS 10000
 #define turnfactor float2fix5(0.07)
 #define CD float2fix5(0.1)
 #define CDx float2fix5(0.03)
@@ -85,6 +119,79 @@ char color = BLUE ;
 #define vx_init 3
 #define jump_rand 3
 
+// 1 to store the flock in the packed 4-byte format (see packBoid),
+// 0 for the plain 8-byte struct boid
+#define PACKED_BOIDS 0
+// 1 to time both layouts at startup and print the result
+#define BENCH_LAYOUT 0
+// 1 to run a seeded scene at startup and record a hash and capture of
+// every frame, to compare two builds by hand (see goldenRecord)
+#define GOLDEN_RECORD 0
+
+// How particles reach the framebuffer
+//  RENDER_SPRITE:  each boid erases and redraws its own 2x2 sprite
+//  RENDER_DENSITY: boids are counted into 4x4 pixel cells, and core 0
+//                  colors the touched cells by density once per frame
+//  RENDER_CLEAR:   core 0 blanks last frame's particle spans in bulk,
+//                  boids only draw their sprite and never erase it
+//  RENDER_TILED:   physics first, then core 0 bins the boids by screen
+//                  tile and each core clears and draws only its own
+//                  tiles, so the cores never write the same byte
+//  RENDER_PIPELINE: core 0 runs the physics for frame N+1 while core 1
+//                  draws a snapshot of frame N (cleared as RENDER_CLEAR)
+//  RENDER_SCANLINE: no framebuffer below the HUD, each line is drawn
+//                  from a row-sorted list just before the beam gets
+//                  there (see initVGAScanline), nothing is ever erased
+#define RENDER_SPRITE 0
+#define RENDER_DENSITY 1
+#define RENDER_CLEAR 2
+#define RENDER_TILED 3
+#define RENDER_PIPELINE 4
+#define RENDER_SCANLINE 5
+#define RENDER_MODE RENDER_SPRITE
+
+// 1 to run the display at 320x240 with each pixel shown as a 2x2 block.
+// The framebuffer shrinks from 150 KB to 37.5 KB and the flock gets the
+// rest. Drawing keeps its 640x480 coordinates, so a sprite lands on one
+// pixel and the HUD text comes out coarse.
+#define LOW_RES 0
+
+// 1 to keep 2-bit palette indices instead of 3-bit colors, which halves
+// the framebuffer (75 KB) for the flock. The palette holds the colors of
+// the sprite scene; any other color is drawn as the nearest one.
+#define INDEXED_COLOR 0
+#if INDEXED_COLOR
+static const char palette[4] = {BLACK, BLUE, WHITE, MAGENTA} ;
+#endif
+
+// 1 to let the cores pull chunks of CHUNK_BOIDS from a shared index
+// (the faster core ends up doing more), 0 for the fixed even/odd split
+#define WORK_STEALING 0
+#define CHUNK_BOIDS 64
+// number of workers sharing the update (one per core here). Worker
+// state below is sized by this rather than assuming two cores, but
+// only the two cores' anim threads run as workers.
+#define NUM_WORKERS 2
+#if NUM_WORKERS != 2
+#error "the RP2040 has two cores to run the workers, NUM_WORKERS must be 2"
+#endif
+
+// the modes above need both cores to start each frame together
+// (the pipeline has its own handshake and only core 0 does physics)
+#define FRAME_SYNC ((RENDER_MODE != RENDER_SPRITE && RENDER_MODE != RENDER_PIPELINE) || WORK_STEALING)
+#if RENDER_MODE == RENDER_PIPELINE && WORK_STEALING
+#error "RENDER_PIPELINE keeps the physics on core 0, turn off WORK_STEALING"
+#endif
+#if RENDER_MODE == RENDER_SCANLINE && LOW_RES
+#error "RENDER_SCANLINE builds full resolution lines, turn off LOW_RES"
+#endif
+#if INDEXED_COLOR && (LOW_RES || RENDER_MODE == RENDER_SCANLINE)
+#error "INDEXED_COLOR has its own scan-out, turn off LOW_RES and RENDER_SCANLINE"
+#endif
+#if RENDER_MODE == RENDER_SCANLINE && GOLDEN_RECORD
+#error "GOLDEN_RECORD hashes the framebuffer, RENDER_SCANLINE only keeps the HUD lines"
+#endif
+
 // #define visualRange int2fix5(40)
 // #define protectedRange int2fix5(8)
 // #define centeringfacotor float2fix5(0.0005)
@@ -112,7 +219,32 @@ bool height_wrap_flag = 0;
 bool old_width_wrap_flag = 0;
 bool old_height_wrap_flag = 0;
 
-bool hit_flag = 0;
+// set by positionUpdate when a boid bounced, one per core
+bool hit_flag[2] = {0, 0};
+
+// what boids ran into, counted per core for the frame in progress and
+// copied to hit_last when that core's frame ends
+enum hit_kind { HIT_BOUNCE, HIT_RESPAWN, HIT_BLOCK, NUM_HIT_KINDS } ;
+static int hit_count[2][NUM_HIT_KINDS] ;
+static volatile int hit_last[2][NUM_HIT_KINDS] ;
+
+// a bounce also turns the boid white for one frame
+#define countBounce(core, kind) (hit_flag[core] = 1, hit_count[core][kind]++)
+
+// Publish and restart this core's counts at the end of its frame
+static void endHitFrame(int core)
+{
+  for (int k = 0; k<NUM_HIT_KINDS; k++) {
+    hit_last[core][k] = hit_count[core][k] ;
+    hit_count[core][k] = 0 ;
+  }
+}
+
+// Count of one kind over both cores for the last frame
+static int hitTotal(int kind)
+{
+  return hit_last[0][kind] + hit_last[1][kind] ;
+}
 
 struct block {
   fix5 x;
@@ -152,7 +284,55 @@ struct boid {
   fix5 vy ;
 };
 
-struct boid flock[NUM_BOIDS];
+// Packed boid, 32 bits
+//  [31:21] x   unsigned 10.1 (0 .. 1023.5)
+//  [20:11] y   unsigned 9.1, biased by PACK_Y_BIAS pixels
+//  [10:6]  vx  signed 3.1 (-8 .. 7.5)
+//  [5:0]   vy  signed 4.1 (-16 .. 15.5)
+// Fields are half-pixel fix5 values. Positions are truncated so a boid
+// keeps the pixel it was drawn at (the sprite is erased there next
+// frame), velocities are rounded to nearest and saturate. Halves flock
+// memory at the cost of sub-pixel precision.
+#define PACK_Y_BIAS 16
+
+static inline uint32_t packBoid(const struct boid* b)
+{
+  int x  = b->x >> 4 ;
+  int y  = (b->y + int2fix5(PACK_Y_BIAS)) >> 4 ;
+  int vx = (b->vx + 8) >> 4 ;
+  int vy = (b->vy + 8) >> 4 ;
+  x  = min(max(x, 0), 2047) ;
+  y  = min(max(y, 0), 1023) ;
+  vx = min(max(vx, -16), 15) ;
+  vy = min(max(vy, -32), 31) ;
+  return ((uint32_t)x << 21) | ((uint32_t)y << 11) | ((uint32_t)(vx & 0x1f) << 6) | (uint32_t)(vy & 0x3f) ;
+}
+
+static inline void unpackBoid(uint32_t p, struct boid* b)
+{
+  b->x  = (fix5)((p >> 21) << 4) ;
+  b->y  = (fix5)(((p >> 11) & 0x3ff) << 4) - int2fix5(PACK_Y_BIAS) ;
+  b->vx = (fix5)((((int32_t)(p << 21)) >> 27) << 4) ;
+  b->vy = (fix5)((((int32_t)(p << 26)) >> 26) << 4) ;
+}
+
+// Flock storage slot for the selected layout
+#if PACKED_BOIDS
+typedef uint32_t boid_slot ;
+#define loadBoid(s, b)  unpackBoid(*(s), (b))
+#define storeBoid(s, b) (*(s) = packBoid(b))
+#else
+typedef struct boid boid_slot ;
+#define loadBoid(s, b)  (*(b) = *(s))
+#define storeBoid(s, b) (*(s) = *(b))
+#endif
+
+// The flock takes whatever is left of the main SRAM arena once
+// everything else has been allocated (see main). Only the first
+// num_boids entries are simulated.
+boid_slot * flock ;
+int max_boids ;
+volatile int num_boids = INIT_BOIDS ;
 
 // Boid on core 0
 fix5 boid0_x ;
@@ -166,15 +346,48 @@ fix5 boid1_y ;
 fix5 boid1_vx ;
 fix5 boid1_vy ;
 
+// Spawn a single boid at the top of the waterfall
+void spawnBoid(struct boid* b)
+{
+  b->x = int2fix5(640) - int2fix5(rand() & x_INCREMENT) ;
+  b->y = int2fix5(rand() & y_INCREMENT) ;
+  b->vx = -float2fix5((float)(rand() % 2000)/2000.0 + vx_init) ;
+  b->vy = -float2fix5((float)(rand() % 4000)/2000.0 - (rand() %4000)/2000.0) ;
+}
+
 // Create a flock
-void spawnFlock(struct boid* flock)
+void spawnFlock(boid_slot* flock)
 {
-  for (int i = 0; i<NUM_BOIDS; i++) {
+  struct boid b ;
+  for (int i = 0; i<num_boids; i++) {
     // Start in center of screen
-    flock[i].x = int2fix5(640) - int2fix5(rand() & x_INCREMENT) ;
-    flock[i].y = int2fix5(rand() & y_INCREMENT) ;
-    flock[i].vx = -float2fix5((float)(rand() % 2000)/2000.0 + vx_init) ;
-    flock[i].vy = -float2fix5((float)(rand() % 4000)/2000.0 - (rand() %4000)/2000.0) ;
+    spawnBoid(&b) ;
+    storeBoid(&flock[i], &b) ;
+  }
+}
+
+// Change the number of active boids at runtime.
+// New boids are spawned before the count is published so the
+// animation threads never see an uninitialized entry; removed
+// boids are erased after the count drops so nobody redraws them.
+void setNumBoids(int n)
+{
+  if (n < 0) n = 0 ;
+  if (n > max_boids) n = max_boids ;
+  struct boid b ;
+  if (n > num_boids) {
+    for (int i = num_boids; i<n; i++) {
+      spawnBoid(&b) ;
+      storeBoid(&flock[i], &b) ;
+    }
+    num_boids = n ;
+  } else {
+    int old = num_boids ;
+    num_boids = n ;
+    for (int i = n; i<old; i++) {
+      loadBoid(&flock[i], &b) ;
+      drawRect(fix2int5(b.x), fix2int5(b.y), 2, 2, BLACK);
+    }
   }
 }
 
@@ -189,9 +402,342 @@ void hitBottomReact(struct boid* flock, int bottom_wall) {
   flock->y = int2fix5(bottom_wall - 5);
 }
 
+// === density render mode ==========================
+// 160x120 cells of 4x4 pixels, one saturating 4-bit count per cell
+// and worker (two cells share a byte, so the workers keep separate
+// grids and the resolve pass adds them up)
+#define DENS_CELL 4
+#define DENS_W (640/DENS_CELL)
+#define DENS_H (480/DENS_CELL)
+#define DENS_BYTES (DENS_W*DENS_H/2)
+// density -> color thresholds
+#define DENS_CYAN 3
+#define DENS_WHITE 7
+
+unsigned char * dens_count[NUM_WORKERS] ;
+// columns touched per cell row, kept per worker so the workers
+// never race on the same span. prev covers what was colored last
+// frame so that it can be cleared if nothing lands there now.
+short dens_min[NUM_WORKERS][DENS_H], dens_max[NUM_WORKERS][DENS_H] ;
+short dens_prev_min[DENS_H], dens_prev_max[DENS_H] ;
+
+void initDensity(void)
+{
+  dens_count[0] = arena_alloc(ARENA_MAIN, NUM_WORKERS*DENS_BYTES, 4, "density") ;
+  for (int w = 1; w<NUM_WORKERS; w++) dens_count[w] = dens_count[0] + w*DENS_BYTES ;
+  for (int r = 0; r<DENS_H; r++) {
+    for (int w = 0; w<NUM_WORKERS; w++) {
+      dens_min[w][r] = DENS_W ;
+      dens_max[w][r] = -1 ;
+    }
+    dens_prev_min[r] = DENS_W ;
+    dens_prev_max[r] = -1 ;
+  }
+}
+
+// Count a boid into its cell
+static inline void accumulateBoid(fix5 x, fix5 y, int core)
+{
+  int px = fix2int5(x) ;
+  int py = fix2int5(y) ;
+  if (px < 0 || px >= 640 || py < 0 || py >= 480) return ;
+  int cx = px / DENS_CELL ;
+  int cy = py / DENS_CELL ;
+  int cell = cy*DENS_W + cx ;
+  int shift = (cell & 1) << 2 ;
+  unsigned char c = dens_count[core][cell>>1] ;
+  if (((c >> shift) & 0xf) < 0xf) {
+    dens_count[core][cell>>1] = c + (1 << shift) ;
+  }
+  if (cx < dens_min[core][cy]) dens_min[core][cy] = cx ;
+  if (cx > dens_max[core][cy]) dens_max[core][cy] = cx ;
+}
+
+// Cells the resolve pass must not paint: stairs, the movable
+// block and the text at the top of the screen
+static inline bool cellBlocked(int cx, int cy)
+{
+  int x = cx*DENS_CELL ;
+  int y = cy*DENS_CELL ;
+  if (x >= stairLeft(y)) return true ;
+  if (y < HUD_BOTTOM && x < 520) return true ;
+  int bx0 = fix2int5(m_block.x - m_block.length) ;
+  int bx1 = fix2int5(m_block.x + m_block.length) ;
+  int by0 = fix2int5(m_block.y - m_block.width) ;
+  int by1 = fix2int5(m_block.y + m_block.width) ;
+  return (x + DENS_CELL > bx0 && x < bx1 && y + DENS_CELL > by0 && y < by1) ;
+}
+
+// Turn this frame's counts into colors, one pass over touched cells
+// (plus the ones colored last frame), clearing counts as we go
+void resolveDensity(void)
+{
+  for (int cy = 0; cy<DENS_H; cy++) {
+    short cur_lo = DENS_W, cur_hi = -1 ;
+    for (int w = 0; w<NUM_WORKERS; w++) {
+      cur_lo = min(cur_lo, dens_min[w][cy]) ;
+      cur_hi = max(cur_hi, dens_max[w][cy]) ;
+      dens_min[w][cy] = DENS_W ;
+      dens_max[w][cy] = -1 ;
+    }
+    short lo = min(cur_lo, dens_prev_min[cy]) ;
+    short hi = max(cur_hi, dens_prev_max[cy]) ;
+    dens_prev_min[cy] = cur_lo ;
+    dens_prev_max[cy] = cur_hi ;
+    for (int cx = lo; cx<=hi; cx++) {
+      int cell = cy*DENS_W + cx ;
+      int shift = (cell & 1) << 2 ;
+      int n = 0 ;
+      for (int w = 0; w<NUM_WORKERS; w++) {
+        n += (dens_count[w][cell>>1] >> shift) & 0xf ;
+        dens_count[w][cell>>1] &= ~(0xf << shift) ;
+      }
+      if (cellBlocked(cx, cy)) continue ;
+      char c = (n == 0) ? BLACK : (n < DENS_CYAN) ? BLUE : (n < DENS_WHITE) ? CYAN : WHITE ;
+      fillRectAligned(cx*DENS_CELL, cy*DENS_CELL, DENS_CELL, DENS_CELL, c) ;
+    }
+  }
+}
+
+// === clear render mode ============================
+// Rows of the screen are grouped into 8-line bands (the stair edges
+// at 120/240/360 fall on band boundaries). Each worker records the
+// columns it drew into per band; at the start of the next frame
+// core 0 blanks those spans with byte-wide fills.
+#define CLR_BAND 8
+#define CLR_BANDS (480/CLR_BAND)
+
+short clr_min[NUM_WORKERS][CLR_BANDS], clr_max[NUM_WORKERS][CLR_BANDS] ;
+
+void initClear(void)
+{
+  for (int b = 0; b<CLR_BANDS; b++) {
+    for (int w = 0; w<NUM_WORKERS; w++) {
+      clr_min[w][b] = 640 ;
+      clr_max[w][b] = -1 ;
+    }
+  }
+}
+
+// Remember that a 2x2 sprite was drawn at (x,y)
+static inline void markDrawn(int x, int y, int core)
+{
+  if (y < 0) y = 0 ;
+  if (y > 478) y = 478 ;
+  int b0 = y / CLR_BAND ;
+  int b1 = (y + 1) / CLR_BAND ;
+  if (x < clr_min[core][b0]) clr_min[core][b0] = x ;
+  if (x > clr_max[core][b0]) clr_max[core][b0] = x ;
+  if (b1 != b0) {
+    if (x < clr_min[core][b1]) clr_min[core][b1] = x ;
+    if (x > clr_max[core][b1]) clr_max[core][b1] = x ;
+  }
+}
+
+// Blank columns [x0,x1) of rows [y0,y1), leaving the movable block alone
+static void clearSpan(int x0, int x1, int y0, int y1)
+{
+  int bx0 = fix2int5(m_block.x - m_block.length) & ~1 ;
+  int bx1 = (fix2int5(m_block.x + m_block.length) + 1) & ~1 ;
+  int by0 = max(fix2int5(m_block.y - m_block.width), y0) ;
+  int by1 = min(fix2int5(m_block.y + m_block.width), y1) ;
+  if (by0 >= by1 || bx1 <= x0 || bx0 >= x1) {
+    fillRectAligned(x0, y0, x1-x0, y1-y0, BLACK) ;
+    return ;
+  }
+  fillRectAligned(x0, y0, x1-x0, by0-y0, BLACK) ;
+  fillRectAligned(x0, by0, bx0-x0, by1-by0, BLACK) ;
+  fillRectAligned(bx1, by0, x1-bx1, by1-by0, BLACK) ;
+  fillRectAligned(x0, by1, x1-x0, y1-by1, BLACK) ;
+}
+
+// Blank everything drawn last frame, except the stairs and the text
+void clearParticles(void)
+{
+  for (int b = 0; b<CLR_BANDS; b++) {
+    int lo = 640, hi = -1 ;
+    for (int w = 0; w<NUM_WORKERS; w++) {
+      lo = min(lo, clr_min[w][b]) ;
+      hi = max(hi, clr_max[w][b]) ;
+      clr_min[w][b] = 640 ;
+      clr_max[w][b] = -1 ;
+    }
+    if (hi < 0) continue ;
+    int y0 = b*CLR_BAND ;
+    // sprites are 2 wide, round out to whole bytes
+    lo = lo & ~1 ;
+    hi = (hi + 3) & ~1 ;
+    // stop at the stair face for this band
+    int stair = stairLeft(y0) ;
+    if (hi > stair) hi = stair ;
+    if (y0 < HUD_BOTTOM) {
+      // skip the text between x=64 and x=512
+      if (lo < 64) clearSpan(lo, min(hi, 64), y0, y0+CLR_BAND) ;
+      if (hi > 512) clearSpan(max(lo, 512), hi, y0, y0+CLR_BAND) ;
+    } else if (lo < hi) {
+      clearSpan(lo, hi, y0, y0+CLR_BAND) ;
+    }
+  }
+}
+
+// Sprites the deferred draw passes (tiled, pipeline) skip: the stair
+// corners and the movable block (as in positionUpdate) and the text
+// at the top of the screen, which the bulk clears leave alone
+static inline bool spriteHidden(fix5 x, fix5 y)
+{
+  if ((x >= int2fix5(519) && x <= int2fix5(530)) && (y >= int2fix5(119) && y <= int2fix5(130))) return true ;
+  if ((x >= int2fix5(399) && x <= int2fix5(410)) && (y >= int2fix5(239) && y <= int2fix5(250))) return true ;
+  if ((x >= int2fix5(279) && x <= int2fix5(290)) && (y >= int2fix5(359) && y <= int2fix5(370))) return true ;
+  if ((x >= (m_block.x-m_block.length-int2fix5(1)) && x <= (m_block.x+m_block.length+int2fix5(1))) && (y >= (m_block.y-m_block.width-int2fix5(1)) && y <= (m_block.y+m_block.width+int2fix5(1)))) return true ;
+  int px = fix2int5(x) ;
+  return (fix2int5(y) < HUD_BOTTOM && px >= 63 && px < 512) ;
+}
+
+// === tiled render mode ============================
+// The screen is cut into 40x40 pixel tiles, handed out to the workers
+// in a checkerboard. Tile edges fall on even columns (two pixels per
+// framebuffer byte) and on the stair edges. Once both cores are done
+// with the physics, core 0 sorts the boid indices by tile; each core
+// then clears and redraws only the tiles it owns, so the raster pass
+// needs no locking and walks the framebuffer one tile at a time.
+#define TILE 40
+#define TILES_X (640/TILE)
+#define TILES_Y (480/TILE)
+#define NUM_TILES (TILES_X*TILES_Y)
+#define tileOwner(t) ((((t) % TILES_X) + ((t) / TILES_X)) % NUM_WORKERS)
+// sprites hanging over a tile edge, kept so the neighbor tiles can
+// draw their part (any beyond this lose the overhanging pixels)
+#define STRADDLE_MAX 1024
+// arena bytes per boid on top of the flock slot
+#define TILE_BYTES_PER_BOID (sizeof(uint16_t) + 1)
+
+// boid indices grouped by tile, tile t owns [tile_start[t], tile_start[t+1])
+uint16_t * bin_order ;
+uint16_t tile_start[NUM_TILES+1] ;
+// whether each boid bounced this frame (drawn white)
+unsigned char * boid_hit ;
+uint16_t straddle[STRADDLE_MAX] ;
+int straddle_count ;
+// tiles with particles drawn in them, cleared before the next draw
+unsigned char tile_drawn[NUM_TILES] ;
+
+// Allocate the per-boid tables, right after the flock
+void initTiles(int n)
+{
+  bin_order = arena_alloc(ARENA_MAIN, n*sizeof(uint16_t), 2, "tile bins") ;
+  boid_hit = arena_alloc(ARENA_MAIN, n, 1, "boid hits") ;
+  memset(boid_hit, 0, n) ;
+}
+
+static inline int tileOf(int x, int y)
+{
+  x = min(max(x, 0), 639) ;
+  y = min(max(y, 0), 479) ;
+  return (y / TILE)*TILES_X + x / TILE ;
+}
+
+// Counting sort of the flock by tile, run on core 0 after the physics
+void binTiles(void)
+{
+  static uint16_t fill[NUM_TILES] ;
+  struct boid b ;
+  int n = num_boids ;
+  memset(tile_start, 0, sizeof(tile_start)) ;
+  for (int i = 0; i<n; i++) {
+    loadBoid(&flock[i], &b) ;
+    tile_start[tileOf(fix2int5(b.x), fix2int5(b.y)) + 1]++ ;
+  }
+  for (int t = 0; t<NUM_TILES; t++) {
+    tile_start[t+1] += tile_start[t] ;
+    fill[t] = tile_start[t] ;
+  }
+  straddle_count = 0 ;
+  for (int i = 0; i<n; i++) {
+    loadBoid(&flock[i], &b) ;
+    int x = fix2int5(b.x) ;
+    int y = fix2int5(b.y) ;
+    int t = tileOf(x, y) ;
+    bin_order[fill[t]++] = i ;
+    if ((tileOf(x+1, y) != t || tileOf(x, y+1) != t) && straddle_count < STRADDLE_MAX) {
+      straddle[straddle_count++] = i ;
+    }
+  }
+}
+
+// Blank a tile, leaving the stairs, the text and the block alone
+static void clearTile(int x0, int y0)
+{
+  int x1 = x0 + TILE ;
+  int y1 = y0 + TILE ;
+  if (x0 >= stairLeft(y0)) return ;
+  if (y0 < HUD_BOTTOM) {
+    // skip the text between x=64 and x=512
+    int yh = min(y1, HUD_BOTTOM) ;
+    if (x0 < 64) clearSpan(x0, min(x1, 64), y0, yh) ;
+    if (x1 > 512) clearSpan(max(x0, 512), x1, y0, yh) ;
+    y0 = yh ;
+  }
+  if (y0 < y1) clearSpan(x0, x1, y0, y1) ;
+}
+
+// Draw the part of a 2x2 sprite at (x,y) that lies in the tile at (x0,y0)
+static inline void drawClipped(int x, int y, char c, int x0, int y0)
+{
+  for (int py = max(y, y0); py < min(y+2, y0+TILE); py++) {
+    for (int px = max(x, x0); px < min(x+2, x0+TILE); px++) {
+      drawPixel(px, py, c) ;
+    }
+  }
+}
+
+// Clear and draw this core's tiles
+void rasterTiles(int core)
+{
+  struct boid b ;
+  for (int t = 0; t<NUM_TILES; t++) {
+    if (tileOwner(t) != core) continue ;
+    int x0 = (t % TILES_X)*TILE ;
+    int y0 = (t / TILES_X)*TILE ;
+    if (tile_drawn[t]) {
+      clearTile(x0, y0) ;
+      tile_drawn[t] = 0 ;
+    }
+    for (int k = tile_start[t]; k<tile_start[t+1]; k++) {
+      int i = bin_order[k] ;
+      loadBoid(&flock[i], &b) ;
+      if (spriteHidden(b.x, b.y)) continue ;
+      drawClipped(fix2int5(b.x), fix2int5(b.y), boid_hit[i] ? WHITE : BLUE, x0, y0) ;
+      tile_drawn[t] = 1 ;
+    }
+  }
+  // parts of sprites binned in a neighbor that hang into our tiles
+  // (all of our tiles are cleared by now)
+  for (int k = 0; k<straddle_count; k++) {
+    int i = straddle[k] ;
+    loadBoid(&flock[i], &b) ;
+    if (spriteHidden(b.x, b.y)) continue ;
+    int x = fix2int5(b.x) ;
+    int y = fix2int5(b.y) ;
+    int home = tileOf(x, y) ;
+    int right = tileOf(x+1, y) ;
+    int below = tileOf(x, y+1) ;
+    int diag = tileOf(x+1, y+1) ;
+    int over[3] = {right, below, (diag != right && diag != below) ? diag : home} ;
+    for (int j = 0; j<3; j++) {
+      int t = over[j] ;
+      if (t == home || tileOwner(t) != core) continue ;
+      drawClipped(x, y, boid_hit[i] ? WHITE : BLUE, (t % TILES_X)*TILE, (t / TILES_X)*TILE) ;
+      tile_drawn[t] = 1 ;
+    }
+  }
+}
+
 // Position Update method 
 void positionUpdate(struct boid* flock, int i)
 {
+  int core = get_core_num() ;
+  STAGE_START() ;
+#if RENDER_MODE == RENDER_SPRITE
   if ((flock[i].x >= int2fix5(519) && flock[i].x <= int2fix5(530)) && (flock[i].y >= int2fix5(119) && flock[i].y <= int2fix5(130))){
   }
   else if ((flock[i].x >= int2fix5(399) && flock[i].x <= int2fix5(410)) && (flock[i].y >= int2fix5(239) && flock[i].y <= int2fix5(250))){
@@ -203,8 +749,11 @@ void positionUpdate(struct boid* flock, int i)
   else{
     drawRect(fix2int5(flock[i].x), fix2int5(flock[i].y), 2, 2, BLACK);
   }
+  STAGE_MARK(STAGE_ERASE) ;
+#endif
   flock[i].vx = flock[i].vx - multfix5(flock[i].vx, CDx);
   flock[i].vy = flock[i].vy + G30 - multfix5(flock[i].vy, CD );
+  STAGE_MARK(STAGE_INTEGRATE) ;
 
   // teleport!
   if (hitLeft(flock[i].x + flock[i].vx)) {
@@ -212,11 +761,12 @@ void positionUpdate(struct boid* flock, int i)
     flock[i].y = int2fix5(rand() & y_INCREMENT) ;
     flock[i].vx = -float2fix5((float)(rand() % 2000)/2000.0 + vx_init) ;
     flock[i].vy = -float2fix5((float)(rand() % 4000)/2000.0 - (rand() %4000)/2000.0) ;
+    hit_count[core][HIT_RESPAWN]++ ;
   }
 
   if (flock[i].x >= m_block.x-m_block.length && flock[i].x <= m_block.x+m_block.length){
     if (hitBottom(flock[i].y + flock[i].vy, fix2int5(m_block.y-m_block.width)) && !hitBottom(flock[i].y, fix2int5(m_block.y-m_block.width))) {
-      hit_flag = 1;
+      countBounce(core, HIT_BLOCK);
       hitBottomReact(flock+i, fix2int5(m_block.y-m_block.width));
     }
   }
@@ -227,7 +777,7 @@ void positionUpdate(struct boid* flock, int i)
       int bottom_wall = 479;
 
       if (hitBottom(flock[i].y + flock[i].vy, bottom_wall)){
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitBottomReact(flock+i, bottom_wall);
       }
 
@@ -237,14 +787,14 @@ void positionUpdate(struct boid* flock, int i)
       int bottom_wall = 479;
 
       if (hitBottom(flock[i].y+ flock[i].vy, bottom_wall) && hitRight(flock[i].x + flock[i].vx, right_wall)) {
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitRightReact(flock+i, right_wall);
         hitBottomReact(flock+i, bottom_wall);
       } else if (hitBottom(flock[i].y + flock[i].vy, bottom_wall)){
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitBottomReact(flock+i, bottom_wall);
       } else if (hitRight(flock[i].x + flock[i].vx, right_wall)){
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitRightReact(flock+i, right_wall);
       }
 
@@ -254,14 +804,14 @@ void positionUpdate(struct boid* flock, int i)
       int bottom_wall = 359;
 
       if (hitBottom(flock[i].y + flock[i].vy, bottom_wall) && hitRight(flock[i].x + flock[i].vx, right_wall)) {
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitBottomReact(flock+i, bottom_wall);
         hitRightReact(flock+i, right_wall);
       } else if (hitBottom(flock[i].y + flock[i].vy, bottom_wall)){
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitBottomReact(flock+i, bottom_wall);
       } else if (hitRight(flock[i].x + flock[i].vx, right_wall)){
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitRightReact(flock+i, right_wall);
       }
 
@@ -270,25 +820,25 @@ void positionUpdate(struct boid* flock, int i)
       int right_wall = 519;
       int bottom_wall = 239;
       if (hitBottom(flock[i].y + flock[i].vy , bottom_wall) && hitRight(flock[i].x + flock[i].vx, right_wall)) {
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitBottomReact(flock+i, bottom_wall);
         hitRightReact(flock+i, right_wall);
       } else if (hitBottom(flock[i].y + flock[i].vy, bottom_wall)){
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitBottomReact(flock+i, bottom_wall);
       } else if (hitRight(flock[i].x + flock[i].vx, right_wall)){
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitRightReact(flock+i, right_wall);
       }
     } else{
       int right_wall = 639;
       int bottom_wall = 119;
       if (hitBottom(flock[i].y + flock[i].vy, bottom_wall)) {
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitBottomReact(flock+i, bottom_wall);
       }
       if (hitRight(flock[i].x + flock[i].vx, right_wall)) {
-        hit_flag = 1;
+        countBounce(core, HIT_BOUNCE);
         hitRightReact(flock+i, right_wall);
       }
     }
@@ -296,7 +846,7 @@ void positionUpdate(struct boid* flock, int i)
 
   else {
     if (hitBottom(flock[i].y + flock[i].vy, 479)) {
-      hit_flag = 1;
+      countBounce(core, HIT_BOUNCE);
       flock[i].vy = - multfix5(flock[i].vy, RC) + float2fix5((float)(jump_rand*(rand() % 4000)/2000.0));
       flock[i].y = int2fix5(479 - 1);
     }
@@ -306,13 +856,26 @@ void positionUpdate(struct boid* flock, int i)
       flock[i].y = int2fix5(rand() & y_INCREMENT) ;
       flock[i].vx = -float2fix5((float)(rand() % 2000)/2000.0 + vx_init) ;
       flock[i].vy = -float2fix5((float)(rand() % 4000)/2000.0 - (rand() %4000)/2000.0) ;
+      hit_count[core][HIT_RESPAWN]++ ;
     }
   }
+  STAGE_MARK(STAGE_COLLIDE) ;
   
   flock[i].x = flock[i].x + flock[i].vx ;
   flock[i].y = flock[i].y + flock[i].vy ;
+  STAGE_MARK(STAGE_INTEGRATE) ;
 
   //Draw each boid
+#if RENDER_MODE == RENDER_DENSITY
+  accumulateBoid(flock[i].x, flock[i].y, core) ;
+  hit_flag[core] = 0;
+#elif RENDER_MODE == RENDER_TILED
+  // drawn by rasterTiles, parallel keeps hit_flag in boid_hit
+#elif RENDER_MODE == RENDER_PIPELINE
+  // drawn on core 1 from the snapshot, see pipelinePhysics
+#elif RENDER_MODE == RENDER_SCANLINE
+  // drawn by renderLine, parallel keeps hit_flag in boid_hit
+#else
   if ((flock[i].x >= int2fix5(519) && flock[i].x <= int2fix5(530)) && (flock[i].y >= int2fix5(119) && flock[i].y <= int2fix5(130))){
   }
   else if ((flock[i].x >= int2fix5(399) && flock[i].x <= int2fix5(410)) && (flock[i].y >= int2fix5(239) && flock[i].y <= int2fix5(250))){
@@ -322,28 +885,277 @@ void positionUpdate(struct boid* flock, int i)
   else if ((flock[i].x >= (m_block.x-m_block.length-int2fix5(1)) && flock[i].x <= (m_block.x+m_block.length+int2fix5(1))) && (flock[i].y >= (m_block.y-m_block.width-int2fix5(1)) && flock[i].y <= (m_block.y+m_block.width+int2fix5(1)))){
   }
   else{
-    if (hit_flag){
+    if (hit_flag[core]){
       drawRect(fix2int5(flock[i].x), fix2int5(flock[i].y), 2, 2, WHITE);
     } else{
       drawRect(fix2int5(flock[i].x), fix2int5(flock[i].y), 2, 2, BLUE);
     }
-    hit_flag = 0;
+    hit_flag[core] = 0;
+#if RENDER_MODE == RENDER_CLEAR
+    markDrawn(fix2int5(flock[i].x), fix2int5(flock[i].y), core) ;
+#endif
   }
+#endif
+  STAGE_MARK(STAGE_DRAW) ;
+}
+
+// Update one packed boid: unpack, run the normal kernel, repack
+static inline void positionUpdatePacked(uint32_t* pflock, int i)
+{
+  struct boid b ;
+  unpackBoid(pflock[i], &b) ;
+  positionUpdate(&b, 0) ;
+  pflock[i] = packBoid(&b) ;
+}
 
+// update kernel for the selected layout
+#if PACKED_BOIDS
+#define updateBoid(flock, i) positionUpdatePacked(flock, i)
+#else
+#define updateBoid(flock, i) positionUpdate(flock, i)
+#endif
+
+// keep the bounce for the tiled raster pass
+#if RENDER_MODE == RENDER_TILED || RENDER_MODE == RENDER_SCANLINE
+#define recordHit(i) (boid_hit[i] = hit_flag[get_core_num()], hit_flag[get_core_num()] = 0)
+#else
+#define recordHit(i)
+#endif
+
+// === pipelined render mode ========================
+// Core 0 runs the physics for every boid and writes the positions to
+// one of two snapshot slots; core 1 clears last frame's spans and
+// draws the other slot. Slots change hands over the SIO FIFO: core 1
+// sends a token when a slot is free, core 0 answers with the slot and
+// boid count of a finished frame, (count << 1) | slot.
+// Snapshot entry: pixel x in [31:16], pixel y in [15:2], flags in [1:0]
+#define SNAP_HIT 1
+#define SNAP_HIDDEN 2
+// arena bytes per boid on top of the flock slot
+#define PIPE_BYTES_PER_BOID (2*sizeof(uint32_t))
+
+uint32_t * snap[2] ;
+
+void initPipeline(int n)
+{
+  snap[0] = arena_alloc(ARENA_MAIN, n*sizeof(uint32_t), 4, "snapshot 0") ;
+  snap[1] = arena_alloc(ARENA_MAIN, n*sizeof(uint32_t), 4, "snapshot 1") ;
+}
 
+static inline uint32_t snapBoid(const struct boid* b, int flags)
+{
+  return ((uint32_t)(uint16_t)fix2int5(b->x) << 16) | ((uint32_t)(fix2int5(b->y) << 2) & 0xfffc) | flags ;
+}
+
+// Physics for the first n boids on core 0, recorded into slot s
+void pipelinePhysics(int s, int n)
+{
+  struct boid b ;
+  uint32_t* out = snap[s] ;
+  for (int i = 0; i<n; i++) {
+    updateBoid(flock, i) ;
+    loadBoid(&flock[i], &b) ;
+    out[i] = snapBoid(&b, (hit_flag[0] ? SNAP_HIT : 0) | (spriteHidden(b.x, b.y) ? SNAP_HIDDEN : 0)) ;
+    hit_flag[0] = 0 ;
+  }
+}
+
+// Draw slot s on core 1, remembering the spans for clearParticles
+void drawSnapshot(int s, int n)
+{
+  uint32_t* in = snap[s] ;
+  for (int i = 0; i<n; i++) {
+    uint32_t e = in[i] ;
+    if (e & SNAP_HIDDEN) continue ;
+    int x = (int16_t)(e >> 16) ;
+    int y = ((int16_t)(e & 0xffff)) >> 2 ;
+    drawRect(x, y, 2, 2, (e & SNAP_HIT) ? WHITE : BLUE) ;
+    markDrawn(x, y, 1) ;
+  }
 }
 
-void parallel(struct boid* flock, int core_num) {
-  if (core_num == 1) {
-    for (int i = 0; i<NUM_BOIDS; i += 2) {
-      positionUpdate(flock, i);
+// === scanline render mode =========================
+// Once both cores are through the physics, core 0 sorts the visible
+// boids by row into one of two slots. The DMA interrupt draws each
+// line from the slot it latched at line 0, so a slot is only written
+// after the renderer has moved on to the other one. Entries are
+// snapshot entries (see snapBoid).
+// arena bytes per boid on top of the flock slot
+#define SCAN_BYTES_PER_BOID (2*sizeof(uint32_t) + 1)
+// sprites kept per row. A line draws two rows' worth from the DMA
+// interrupt and must finish within its 32 us, so a crowded row (the
+// pile at the foot of the falls) drops the rest for that frame.
+#define SCAN_ROW_MAX 48
+
+uint32_t * scan_list[2] ;
+// slot s holds the sprites with top row y in [scan_row[s][y], scan_row[s][y+1])
+uint16_t scan_row[2][481] ;
+// slot last sorted, and slot the renderer is drawing
+volatile int scan_ready, scan_shown ;
+
+void initScanline(int n)
+{
+  scan_list[0] = arena_alloc(ARENA_MAIN, n*sizeof(uint32_t), 4, "scan list 0") ;
+  scan_list[1] = arena_alloc(ARENA_MAIN, n*sizeof(uint32_t), 4, "scan list 1") ;
+  boid_hit = arena_alloc(ARENA_MAIN, n, 1, "boid hits") ;
+  memset(boid_hit, 0, n) ;
+}
+
+static inline bool scanVisible(const struct boid* b)
+{
+  int x = fix2int5(b->x) ;
+  int y = fix2int5(b->y) ;
+  return x >= 0 && x < 640 && y >= 0 && y < 480 && !spriteHidden(b->x, b->y) ;
+}
+
+// Counting sort of the flock by row into the free slot, on core 0
+void sortScanline(void)
+{
+  static uint16_t fill[480] ;
+  struct boid b ;
+  int s = scan_ready ^ 1 ;
+  uint16_t* row = scan_row[s] ;
+  int n = num_boids ;
+  memset(row, 0, sizeof(scan_row[s])) ;
+  for (int i = 0; i<n; i++) {
+    loadBoid(&flock[i], &b) ;
+    if (scanVisible(&b) && row[fix2int5(b.y) + 1] < SCAN_ROW_MAX) row[fix2int5(b.y) + 1]++ ;
+  }
+  for (int y = 0; y<480; y++) {
+    row[y+1] += row[y] ;
+    fill[y] = row[y] ;
+  }
+  for (int i = 0; i<n; i++) {
+    loadBoid(&flock[i], &b) ;
+    if (!scanVisible(&b)) continue ;
+    int y = fix2int5(b.y) ;
+    if (fill[y] == row[y+1]) continue ;
+    scan_list[s][fill[y]++] = snapBoid(&b, boid_hit[i] ? SNAP_HIT : 0) ;
+  }
+  scan_ready = s ;
+}
+
+static inline void __time_critical_func(linePixel)(unsigned char* line, int x, char c)
+{
+  if (x & 1) line[x>>1] = (line[x>>1] & 0b11000111) | (c << 3) ;
+  else line[x>>1] = (line[x>>1] & 0b11111000) | c ;
+}
+
+// Draw the stairs, the block and the sprites covering line y (DMA
+// interrupt, so it runs from RAM)
+void __time_critical_func(renderLine)(short y, unsigned char* line)
+{
+  if (y == 0) scan_shown = scan_ready ;
+  int s = scan_shown ;
+  // stair faces fall on even columns, so whole bytes of white
+  int stair = stairLeft(y) ;
+  memset(line + (stair>>1), (WHITE << 3) | WHITE, (640 - stair)>>1) ;
+  int by = fix2int5(m_block.y - m_block.width) ;
+  if (y >= by && y < by + fix2int5(m_block.width<<1)) {
+    int bx = fix2int5(m_block.x - m_block.length) ;
+    int bx1 = min(bx + fix2int5(m_block.length<<1), 640) ;
+    for (int x = max(bx, 0); x<bx1; x++) linePixel(line, x, MAGENTA) ;
+  }
+  // 2x2 sprites from this row and the one above
+  for (int k = scan_row[s][max(y-1, 0)]; k<scan_row[s][y+1]; k++) {
+    uint32_t e = scan_list[s][k] ;
+    int x = (int16_t)(e >> 16) ;
+    char c = (e & SNAP_HIT) ? WHITE : BLUE ;
+    linePixel(line, x, c) ;
+    if (x < 639) linePixel(line, x+1, c) ;
+  }
+}
+
+// === work stealing ================================
+// A shared index hands out chunks of boids under a hardware spinlock
+// (the M0+ has no atomic read-modify-write). Core 0 resets it at the
+// start of each frame while core 1 waits in the frame handshake.
+spin_lock_t * work_lock ;
+volatile int work_next ;
+// boids each worker updated in the last frame
+volatile int work_done[NUM_WORKERS] ;
+
+void initWorkStealing(void)
+{
+  work_lock = spin_lock_instance(spin_lock_claim_unused(true)) ;
+  work_next = 0 ;
+}
+
+// claim the next chunk, returns its first index
+static inline int grabChunk(void)
+{
+  uint32_t save = spin_lock_blocking(work_lock) ;
+  int start = work_next ;
+  work_next = start + CHUNK_BOIDS ;
+  spin_unlock(work_lock, save) ;
+  return start ;
+}
+
+void parallel(boid_slot* flock, int core_num) {
+#if WORK_STEALING
+  int n = num_boids ;
+  int start, done = 0 ;
+  while ((start = grabChunk()) < n) {
+    int end = min(start + CHUNK_BOIDS, n) ;
+    for (int i = start; i<end; i++) {
+      updateBoid(flock, i);
+      recordHit(i);
     }
-  } else {
-    for (int i = 1; i<NUM_BOIDS; i += 2) {
-      positionUpdate(flock, i);
+    done += end - start ;
+  }
+  work_done[core_num] = done ;
+#else
+  // interleaved split, worker NUM_WORKERS-1 starts at boid 0
+  for (int i = NUM_WORKERS - 1 - core_num; i<num_boids; i += NUM_WORKERS) {
+    updateBoid(flock, i);
+    recordHit(i);
+  }
+#endif
+}
+
+#if BENCH_LAYOUT
+// Time the update kernel on both layouts over the same boids.
+// Runs on core 0 before the animation starts, using the (not yet
+// spawned) flock arena as scratch, then clears the screen.
+#define BENCH_FRAMES 30
+void benchmarkLayouts(void)
+{
+  int n = (max_boids*sizeof(boid_slot)) / (sizeof(struct boid) + sizeof(uint32_t)) ;
+  if (n > INIT_BOIDS) n = INIT_BOIDS ;
+  struct boid* plain = (struct boid*)flock ;
+  uint32_t* packed = (uint32_t*)(plain + n) ;
+  uint32_t t, plain_us, packed_us ;
+
+  for (int i = 0; i<n; i++) {
+    spawnBoid(&plain[i]) ;
+    packed[i] = packBoid(&plain[i]) ;
+  }
+
+  t = time_us_32() ;
+  for (int f = 0; f<BENCH_FRAMES; f++) {
+    for (int i = 0; i<n; i++) {
+      positionUpdate(plain, i) ;
     }
   }
+  plain_us = time_us_32() - t ;
+
+  t = time_us_32() ;
+  for (int f = 0; f<BENCH_FRAMES; f++) {
+    for (int i = 0; i<n; i++) {
+      positionUpdatePacked(packed, i) ;
+    }
+  }
+  packed_us = time_us_32() - t ;
+
+  printf("layout bench: %d boids x %d frames, one core\n\r", n, BENCH_FRAMES) ;
+  printf("  8-byte struct: %u us/frame, %u boids/ms, %u bytes\n\r",
+         plain_us/BENCH_FRAMES, (uint32_t)n*BENCH_FRAMES*1000/plain_us, n*sizeof(struct boid)) ;
+  printf("  4-byte packed: %u us/frame, %u boids/ms, %u bytes\n\r",
+         packed_us/BENCH_FRAMES, (uint32_t)n*BENCH_FRAMES*1000/packed_us, n*sizeof(uint32_t)) ;
+
+  fillRect(0, 0, 640, 480, BLACK) ;
 }
+#endif
 
 
 // ==================================================
@@ -391,6 +1203,8 @@ static PT_THREAD (protothread_serial(struct pt *pt))
 
 // This monitors the spare time for maintaining the frame rate
 static int spare_time_for_display ;
+// frames put on screen so far, the HUD shows the rate
+static volatile int frames_drawn ;
 
 // Animation on core 0
 static PT_THREAD (protothread_anim(struct pt *pt))
@@ -399,31 +1213,353 @@ static PT_THREAD (protothread_anim(struct pt *pt))
     PT_BEGIN(pt);
 
     // Variables for maintaining frame rate
-    static int begin_time ;
+    static pt_time_t begin_time ;
+#if VBLANK_PACING
+    static uint32_t begin_refresh ;
+#endif
+    // frame handshake with core 1 (see FRAME_SYNC)
+    static uint32_t fifo_msg ;
+#if RENDER_MODE == RENDER_PIPELINE
+    // snapshot slot the physics writes next
+    static int slot = 0 ;
+    static int frame_n ;
+#endif
 
     // Spawn a boid
-    // for (int i=0; i<NUM_BOIDS; i++) {
+    // for (int i=0; i<num_boids; i++) {
     //   spawnBoid(&boid0_x, &boid0_y, &boid0_vx, &boid0_vy, 0);
     // }
 
     spawnFlock(flock);
+#if STAGE_TIMING
+    stage_init_core() ;
+#endif
  
     while(1) {
       // Measure time at start of thread
-      begin_time = time_us_32() ;    
-
+      begin_time = PT_GET_TIME_usec64() ;    
+#if VBLANK_PACING
+      begin_refresh = vga_frame_count ;
+#endif
+      TRACE(EV_FRAME_BEGIN, frames_drawn) ;
+
+#if FRAME_SYNC
+      // wait for core 1 to finish the previous frame, then resolve
+      // or clear it before either core touches the next one
+      TRACE(EV_WAIT_BEGIN, 0) ;
+      PT_FIFO_READ(fifo_msg) ;
+      TRACE(EV_WAIT_END, 0) ;
+      STAGE_START() ;
+#if RENDER_MODE == RENDER_DENSITY
+      resolveDensity() ;
+      STAGE_MARK(STAGE_DRAW) ;
+#elif RENDER_MODE == RENDER_CLEAR
+      clearParticles() ;
+      STAGE_MARK(STAGE_ERASE) ;
+#elif RENDER_MODE == RENDER_SCANLINE
+      // the slot to sort into is free once the renderer has taken
+      // the last one
+      PT_YIELD_UNTIL(pt, scan_shown == scan_ready) ;
+      STAGE_START() ;
+      sortScanline() ;
+      STAGE_MARK(STAGE_DRAW) ;
+#endif
+#if WORK_STEALING
+      work_next = 0 ;
+#endif
+      PT_FIFO_WRITE(0) ;
+#endif
+
+#if RENDER_MODE == RENDER_PIPELINE
+      // physics for the next frame while core 1 draws the last one,
+      // then wait for core 1 to free a slot and hand this one over
+      frame_n = num_boids ;
+      pipelinePhysics(slot, frame_n) ;
+      TRACE(EV_WAIT_BEGIN, 0) ;
+      PT_FIFO_READ(fifo_msg) ;
+      TRACE(EV_WAIT_END, 0) ;
+      PT_FIFO_WRITE(((uint32_t)frame_n << 1) | slot) ;
+      slot ^= 1 ;
+#else
       // update boid's position and velocity
       parallel(flock,0) ;
+      frames_drawn++ ;
+#endif
+#if RENDER_MODE == RENDER_TILED
+      // once core 1 is through its physics, bin the flock and
+      // let both cores draw their tiles
+      TRACE(EV_WAIT_BEGIN, 1) ;
+      PT_FIFO_READ(fifo_msg) ;
+      TRACE(EV_WAIT_END, 1) ;
+      binTiles() ;
+      PT_FIFO_WRITE(0) ;
+      STAGE_START() ;
+      rasterTiles(0) ;
+      STAGE_MARK(STAGE_DRAW) ;
+#endif
+      STAGE_FRAME_END(pt_sched_us[0]) ;
+      endHitFrame(0) ;
+      TRACE(EV_FRAME_END, frames_drawn) ;
       
       // delay in accordance with frame rate
-      spare_time_for_display = FRAME_RATE - (time_us_32() - begin_time) ;
+      spare_time_for_display = FRAME_RATE - (int)(PT_GET_TIME_usec64() - begin_time) ;
+#if VBLANK_PACING
+      PT_YIELD_UNTIL(pt, vga_frame_count - begin_refresh >= FRAME_VBLANKS) ;
+#else
       // yield for necessary amount of time
       PT_YIELD_usec(spare_time_for_display) ;
+#endif
      // NEVER exit while
     } // END WHILE(1)
   PT_END(pt);
 } // animation thread
 
+// === binary commands ==============================
+// see serial_cmd.h for the frame format
+static struct cmd_parser cmd_parser ;
+// stats record period for protothread_telemetry, 0 when off
+static volatile int telemetry_ms = 0 ;
+// frames between captures for protothread_capture, 0 when off
+static volatile int capture_decimate = 0 ;
+// reply and telemetry frames, built only by core 1's threads, so they
+// live in its scratch bank next to its stack
+static unsigned char * cmd_reply ;
+static unsigned char * telemetry_frame ;
+
+void initCommands(void)
+{
+  cmd_reply = arena_alloc(ARENA_SCRATCH_X, CMD_MAX_FRAME, 4, "cmd reply") ;
+  telemetry_frame = arena_alloc(ARENA_SCRATCH_X, CMD_MAX_FRAME, 4, "telemetry frame") ;
+}
+
+static void drawBlock(char c)
+{
+  fillRect(fix2int5(m_block.x-m_block.length),fix2int5(m_block.y-m_block.width),fix2int5(m_block.length<<1),fix2int5(m_block.width<<1),c);
+}
+
+// Build a stats record frame into out, returns its length
+static int statsFrame(unsigned char* out, unsigned char id)
+{
+  unsigned char rec[36] ;
+  cmd_put32(rec, num_boids) ;
+  cmd_put32(rec+4, frames_drawn) ;
+  cmd_put32(rec+8, spare_time_for_display) ;
+  cmd_put32(rec+12, (int)pt_idle_us[0]) ;
+  cmd_put32(rec+16, (int)pt_idle_us[1]) ;
+  cmd_put32(rec+20, pt_rx_dropped) ;
+  cmd_put32(rec+24, hitTotal(HIT_BOUNCE)) ;
+  cmd_put32(rec+28, hitTotal(HIT_RESPAWN)) ;
+  cmd_put32(rec+32, hitTotal(HIT_BLOCK)) ;
+  return cmd_encode(out, id, rec, sizeof(rec)) ;
+}
+
+// Carry out a command frame, build the reply into out, returns its length
+static int handleCommand(const struct cmd_frame* f, unsigned char* out)
+{
+  unsigned char status = CMD_OK ;
+  int value ;
+  switch (f->id) {
+    case CMD_SET_PARAM:
+      if (f->len != 5) { status = CMD_BAD_LENGTH ; break ; }
+      value = cmd_get32(f->payload+1) ;
+      if (f->payload[0] == PARAM_NUM_BOIDS) {
+        setNumBoids(value) ;
+      } else if (f->payload[0] == PARAM_CAPTURE_DECIMATE) {
+        capture_decimate = max(value, 0) ;
+      } else if (f->payload[0] == PARAM_BLOCK_LENGTH || f->payload[0] == PARAM_BLOCK_WIDTH) {
+        // half sizes, kept small enough that the edges fit a fix5
+        if (value < 0 || value > (f->payload[0] == PARAM_BLOCK_LENGTH ? 320 : 240)) {
+          status = CMD_BAD_PARAM ;
+          break ;
+        }
+        drawBlock(BLACK) ;
+        if (f->payload[0] == PARAM_BLOCK_LENGTH) m_block.length = int2fix5(value) ;
+        else m_block.width = int2fix5(value) ;
+        drawBlock(MAGENTA) ;
+      } else {
+        status = CMD_BAD_PARAM ;
+      }
+      break ;
+    case CMD_MOVE_BLOCK:
+      if (f->len != 4) { status = CMD_BAD_LENGTH ; break ; }
+      value = cmd_get16(f->payload) ;
+      if (value < 0 || value >= 640 || cmd_get16(f->payload+2) < 0 || cmd_get16(f->payload+2) >= 480) {
+        status = CMD_BAD_PARAM ;
+        break ;
+      }
+      drawBlock(BLACK) ;
+      m_block.x = int2fix5(value) ;
+      m_block.y = int2fix5(cmd_get16(f->payload+2)) ;
+      drawBlock(MAGENTA) ;
+      break ;
+    case CMD_QUERY_STATS:
+      return statsFrame(out, CMD_REPLY | CMD_QUERY_STATS) ;
+    case CMD_TELEMETRY:
+      if (f->len != 2) { status = CMD_BAD_LENGTH ; break ; }
+      telemetry_ms = cmd_get16(f->payload) & 0xffff ;
+      break ;
+    default:
+      status = CMD_BAD_ID ;
+  }
+  return cmd_encode(out, CMD_REPLY | f->id, &status, 1) ;
+}
+
+// Stats records at the rate asked for with CMD_TELEMETRY
+static PT_THREAD (protothread_telemetry(struct pt *pt))
+{
+    PT_BEGIN(pt);
+    while(1) {
+      if (telemetry_ms == 0) {
+        PT_YIELD_usec(100000) ;
+        continue ;
+      }
+      PT_YIELD_UNTIL(pt, pt_uart_tx_idle()) ;
+      pt_serial_send((char*)telemetry_frame, statsFrame(telemetry_frame, CMD_REPLY | CMD_TELEMETRY)) ;
+      PT_YIELD_usec(telemetry_ms*1000) ;
+    }
+    PT_END(pt);
+}
+
+// === framebuffer capture ==========================
+// Every capture_decimate frames the scanlines that changed go out over
+// USB CDC, run-length encoded (see frame_capture.h). Lines are compared
+// by hash with the last capture, and every FCAP_KEY_EVERY-th capture
+// sends them all so a decoder can join late. The frame keeps changing
+// while it is sent, so a capture may mix two frames.
+#define FCAP_KEY_EVERY 64
+static unsigned int * fcap_hash ;
+// line record being sent by protothread_capture (core 1 only)
+static unsigned char * fcap_buf ;
+
+void initCapture(void)
+{
+  fcap_hash = arena_alloc(ARENA_MAIN, 480*sizeof(unsigned int), 4, "capture hashes") ;
+  fcap_buf = arena_alloc(ARENA_SCRATCH_X, FCAP_LINE_MAX(VGA_LINE_BYTES), 4, "capture line") ;
+}
+
+static PT_THREAD (protothread_capture(struct pt *pt))
+{
+    PT_BEGIN(pt);
+    static unsigned char shown[VGA_LINE_BYTES] ;
+    static int last_frame, seq, y, key ;
+    while(1) {
+      if (capture_decimate == 0 || !stdio_usb_connected()) {
+        PT_YIELD_usec(100000) ;
+        continue ;
+      }
+      if (frames_drawn - last_frame < capture_decimate) {
+        PT_YIELD_usec(FRAME_RATE) ;
+        continue ;
+      }
+      last_frame = frames_drawn ;
+      key = (seq % FCAP_KEY_EVERY) == 0 ;
+      stdio_usb.out_chars((char*)fcap_buf, fcap_header(fcap_buf, seq, vga_width, vga_lines, key ? FCAP_KEYFRAME : 0)) ;
+      for (y = 0; y<vga_lines; y++) {
+        const unsigned char* line = getLine(y, shown) ;
+        unsigned int h = fcap_line_hash(line, vga_width>>1) ;
+        if (!key && h == fcap_hash[y]) continue ;
+        fcap_hash[y] = h ;
+        stdio_usb.out_chars((char*)fcap_buf, fcap_encode_line(fcap_buf, y, line, vga_width>>1)) ;
+        // let the other threads on this core run between lines
+        PT_YIELD(pt) ;
+      }
+      stdio_usb.out_chars((char*)fcap_buf, fcap_end(fcap_buf)) ;
+      seq++ ;
+    }
+    PT_END(pt);
+}
+
+// Send the whole framebuffer as a keyframe capture, blocking
+void captureFrameNow(int seq)
+{
+  unsigned char buf[FCAP_LINE_MAX(VGA_LINE_BYTES)] ;
+  unsigned char shown[VGA_LINE_BYTES] ;
+  stdio_usb.out_chars((char*)buf, fcap_header(buf, seq, vga_width, vga_lines, FCAP_KEYFRAME)) ;
+  for (int y = 0; y<vga_lines; y++) {
+    const unsigned char* line = getLine(y, shown) ;
+    fcap_hash[y] = fcap_line_hash(line, vga_width>>1) ;
+    stdio_usb.out_chars((char*)buf, fcap_encode_line(buf, y, line, vga_width>>1)) ;
+  }
+  stdio_usb.out_chars((char*)buf, fcap_end(buf)) ;
+}
+
+#if GOLDEN_RECORD
+// === golden frames ================================
+// A fixed scene (seed, boid count, block) is run for GOLDEN_FRAMES
+// frames on core 0 alone, stepping both workers' share in turn, and
+// the hash of the whole framebuffer after each frame is printed. This
+// only records; nothing is checked on the device. To test a renderer
+// change that claims identical output, run the build before and after
+// and compare the two hash lists. If USB is connected every frame is
+// also sent as a capture, so capture_decode.py and frame_diff.py can
+// show the pixels that differ. The hashes only match between builds
+// with the same RENDER_MODE and layout.
+#define GOLDEN_SEED 4760
+#define GOLDEN_BOIDS 2000
+#define GOLDEN_FRAMES 16
+
+// One frame of the selected render mode, run by core 0 alone
+static void goldenStep(int n)
+{
+#if RENDER_MODE == RENDER_PIPELINE
+  pipelinePhysics(0, n) ;
+  clearParticles() ;
+  drawSnapshot(0, n) ;
+#else
+#if RENDER_MODE == RENDER_CLEAR
+  clearParticles() ;
+#endif
+#if WORK_STEALING
+  work_next = 0 ;
+#endif
+  for (int w = 0; w<NUM_WORKERS; w++) {
+    parallel(flock, w) ;
+  }
+#if RENDER_MODE == RENDER_DENSITY
+  resolveDensity() ;
+#elif RENDER_MODE == RENDER_TILED
+  binTiles() ;
+  for (int w = 0; w<NUM_WORKERS; w++) {
+    rasterTiles(w) ;
+  }
+#endif
+#endif
+}
+
+void goldenRecord(void)
+{
+  int saved = num_boids ;
+  unsigned int hash[GOLDEN_FRAMES] ;
+
+  // give a capture host a moment to attach
+  for (int t = 0; t<200 && !stdio_usb_connected(); t++) sleep_ms(10) ;
+
+  srand(GOLDEN_SEED) ;
+  num_boids = min(GOLDEN_BOIDS, max_boids) ;
+  spawnFlock(flock) ;
+  m_block.x = int2fix5(600) ;
+  m_block.y = int2fix5(40) ;
+  m_block.length = int2fix5(15) ;
+  m_block.width = int2fix5(4) ;
+  fillRect(0, 0, 640, 480, BLACK) ;
+  drawStairs() ;
+  fillRect(fix2int5(m_block.x-m_block.length),fix2int5(m_block.y-m_block.width),fix2int5(m_block.length<<1),fix2int5(m_block.width<<1),MAGENTA) ;
+
+  for (int f = 0; f<GOLDEN_FRAMES; f++) {
+    goldenStep(num_boids) ;
+    hash[f] = fcap_line_hash(vga_data_array, vga_lines*vga_line_bytes) ;
+    if (stdio_usb_connected()) captureFrameNow(f) ;
+  }
+
+  printf("golden hashes (mode %d, packed %d, seed %d, %d boids):\n\r", RENDER_MODE, PACKED_BOIDS, GOLDEN_SEED, num_boids) ;
+  for (int f = 0; f<GOLDEN_FRAMES; f++) printf("%s%08x", f ? " " : "", hash[f]) ;
+  printf("\n\r") ;
+
+  fillRect(0, 0, 640, 480, BLACK) ;
+  num_boids = saved ;
+}
+#endif
+
 // information display
 static PT_THREAD (protothread_mouse_block(struct pt *pt))
 {
@@ -438,19 +1574,32 @@ static PT_THREAD (protothread_mouse_block(struct pt *pt))
 
     static uint8_t ch ;
     static int user_input ;
+    static int stat_core, stat_i ;
+    static int reply_len ;
+    cmd_init(&cmd_parser) ;
     printf("gywuqgxiwhqx");
 
-    static int begin_time ;
+    static pt_time_t begin_time ;
     static int spare_time ;
     while(1) {
-      while(uart_is_readable(UART_ID)){uart_getc(UART_ID);}
-      PT_YIELD_UNTIL(pt, (int)uart_is_readable(UART_ID)) ;
-      ch = uart_getc(UART_ID);
+      PT_YIELD_UNTIL_EVENT(pt, pt_uart_readable(), PT_WAKE_UART) ;
+      ch = pt_uart_getc();
+
+      // a command frame starts with CMD_SYNC, anything else is a key
+      cmd_expire(&cmd_parser, time_us_32()) ;
+      if (ch == CMD_SYNC || cmd_busy(&cmd_parser)) {
+        if (cmd_feed(&cmd_parser, ch)) {
+          reply_len = handleCommand(&cmd_parser.frame, cmd_reply) ;
+          PT_YIELD_UNTIL(pt, pt_uart_tx_idle()) ;
+          pt_serial_send((char*)cmd_reply, reply_len) ;
+        }
+        continue ;
+      }
       // PT_YIELD_UNTIL(pt, (int)uart_is_writable(UART_ID)) ;
       // uart_putc(UART_ID, ch);
 
       // Measure time at start of thread
-      begin_time = time_us_32() ;
+      begin_time = PT_GET_TIME_usec64() ;
 
       // mouse block update
       if (ch == 'a') {
@@ -501,13 +1650,66 @@ static PT_THREAD (protothread_mouse_block(struct pt *pt))
           m_block.width = int2fix5(user_input);
           fillRect(fix2int5(m_block.x-m_block.length),fix2int5(m_block.y-m_block.width),fix2int5(m_block.length<<1),fix2int5(m_block.width<<1),MAGENTA);
         }
+        else if (ch == 't') {
+          // per-thread CPU time for both cores
+          for (stat_core = 0; stat_core<2; stat_core++) {
+            for (stat_i = 0; pt_stats_line(pt_serial_out_buffer, pt_buffer_size, stat_core, stat_i); stat_i++) {
+              serial_write ;
+            }
+          }
+          sprintf(pt_serial_out_buffer, "idle us: c0 %llu c1 %llu\n\r", pt_idle_us[0], pt_idle_us[1]) ;
+          serial_write ;
+        }
+#if EVENT_TRACE
+        else if (ch == 'e') {
+          // dump both cores' event rings, see event_trace.h
+          trace_pause(1) ;
+          sprintf(pt_serial_out_buffer, "trace begin\n\r") ;
+          serial_write ;
+          for (stat_core = 0; stat_core<2; stat_core++) {
+            for (stat_i = 0; stat_i<(stat_core ? pt_task_count1 : pt_task_count); stat_i++) {
+              sprintf(pt_serial_out_buffer, "thread %d %d %s\n\r", stat_core, stat_i,
+                      (stat_core ? pt_thread_list1 : pt_thread_list)[stat_i].name) ;
+              serial_write ;
+            }
+          }
+          for (stat_i = 0; trace_dump_line(pt_serial_out_buffer, stat_i); stat_i++) {
+            serial_write ;
+          }
+          sprintf(pt_serial_out_buffer, "trace end\n\r") ;
+          serial_write ;
+          trace_reset() ;
+          trace_pause(0) ;
+        }
+#endif
+#if STAGE_TIMING
+        else if (ch == 'p') {
+          // per-stage time per frame, both cores
+          for (stat_core = 0; stat_core<2; stat_core++) {
+            for (stat_i = 0; stage_report_line(pt_serial_out_buffer, stat_core, stat_i); stat_i++) {
+              serial_write ;
+            }
+          }
+        }
+#endif
+        else if (ch == 'n') {
+          // print prompt
+          sprintf(pt_serial_out_buffer, "input the number of particles (max %d): ", max_boids);
+          // non-blocking write
+          serial_write ;
+          // spawn a thread to do the non-blocking serial read
+          serial_read ;
+          // convert input string to number
+          sscanf(pt_serial_in_buffer,"%d", &user_input) ;
+          setNumBoids(user_input) ;
+        }
         else {
           fillRect(fix2int5(m_block.x-m_block.length),fix2int5(m_block.y-m_block.width),fix2int5(m_block.length<<1),fix2int5(m_block.width<<1),MAGENTA);
         }
       }
 
       // delay in accordance with display rate
-      spare_time = FRAME_RATE - (time_us_32() - begin_time) ;
+      spare_time = FRAME_RATE - (int)(PT_GET_TIME_usec64() - begin_time) ;
       // yield for necessary amount of time
       PT_YIELD_usec(spare_time) ;
       // NEVER exit while
@@ -523,21 +1725,24 @@ static PT_THREAD (protothread_vga_information(struct pt *pt))
     PT_BEGIN(pt);
 
     // Variables for maintaining display rate (1Hz)
-    static int begin_time ;
+    static pt_time_t begin_time ;
     static int spare_time ;
     static int elapsed_time = 0;
+    static int last_frames = 0;
+    static uint32_t last_refresh = 0;
 
     setTextColor(WHITE) ;
     setTextSize(1) ;
     // Will be used to write dynamic text to screen
-    static char vgatext[40];
+    static char vgatext[64];
     // fillRect(280,360,360,120,WHITE);
     // fillRect(400,240,240,120,WHITE);
     // fillRect(520,120,120,120,WHITE);
  
     while(1) {
       // Measure time at start of thread
-      begin_time = time_us_32() ;
+      begin_time = PT_GET_TIME_usec64() ;
+      STAGE_START() ;
 
       // Static text on VGA
       setCursor(65, 5) ;
@@ -545,7 +1750,8 @@ static PT_THREAD (protothread_vga_information(struct pt *pt))
       setCursor(65, 15) ;
       writeString("Number of Particles:") ;
       setCursor(190, 15) ;
-      sprintf(vgatext, "%d", NUM_BOIDS) ;
+      fillRect(190, 15, 40, 8, BLACK);
+      sprintf(vgatext, "%d", num_boids) ;
       writeString(vgatext) ;
       setCursor(65, 25) ;
       writeString("Current spare time(us):") ;
@@ -555,9 +1761,7 @@ static PT_THREAD (protothread_vga_information(struct pt *pt))
       // drawHLine(520,120,120,WHITE) ;
       // arena_right 
 
-      fillRect(280,360,360,120,WHITE);
-      fillRect(400,240,240,120,WHITE);
-      fillRect(520,120,120,120,WHITE);
+      drawStairs() ;
 
       // drawVLine(520,120,120,WHITE) ;
       // drawHLine(400,240,120,WHITE) ;
@@ -581,12 +1785,58 @@ static PT_THREAD (protothread_vga_information(struct pt *pt))
         writeString("not enough time!!!") ;
       }
 
+      // frame rate over the last second, to compare render modes
+      setCursor(65, 35) ;
+      writeString("Frames per second:") ;
+      fillRect(190, 35, 40, 8, BLACK);
+      setCursor(190, 35) ;
+      sprintf(vgatext, "%d", frames_drawn - last_frames) ;
+      writeString(vgatext) ;
+      last_frames = frames_drawn ;
+
+      // and the display's, counted at each vsync pulse
+      setCursor(250, 35) ;
+      sprintf(vgatext, "Display refresh: %d", (int)(vga_frame_count - last_refresh)) ;
+      writeString(vgatext) ;
+      last_refresh = vga_frame_count ;
+
+      // what the boids ran into during the last frame
+      fillRect(65, 45, 330, 8, BLACK);
+      setCursor(65, 45) ;
+      sprintf(vgatext, "Bounces %d  respawns %d  block hits %d", hitTotal(HIT_BOUNCE), hitTotal(HIT_RESPAWN), hitTotal(HIT_BLOCK)) ;
+      writeString(vgatext) ;
+
+      // per-thread CPU time (calls, avg and max us per call)
+      setCursor(65, 60) ;
+      writeString("Thread CPU time:") ;
+      static int line ;
+      line = 0 ;
+      for (int core = 0; core<2; core++) {
+        for (int i = 0; pt_stats_line(vgatext, sizeof(vgatext), core, i); i++, line++) {
+          // drop the line ending (if it fit)
+          vgatext[strcspn(vgatext, "\n")] = 0 ;
+          // as wide as the longest line vgatext holds
+          fillRect(65, 70 + 10*line, 6*(sizeof(vgatext)-1), 8, BLACK);
+          setCursor(65, 70 + 10*line) ;
+          writeString(vgatext) ;
+        }
+      }
+
+#if WORK_STEALING
+      // how the last frame was split between the cores, beside the
+      // heading (the thread rows below fill the HUD)
+      fillRect(200, 60, 195, 8, BLACK);
+      sprintf(vgatext, "Boids per core: %d / %d", work_done[0], work_done[1]) ;
+      setCursor(200, 60) ;
+      writeString(vgatext) ;
+#endif
+
       elapsed_time++;
+      STAGE_MARK(STAGE_HUD) ;
 
       // delay in accordance with display rate (1Hz)
-      spare_time = 1000000 - (time_us_32() - begin_time) ;
+      spare_time = 1000000 - (int)(PT_GET_TIME_usec64() - begin_time) ;
 
-      // somethings wrong with this!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
       // yield for necessary amount of time
       PT_YIELD_usec(spare_time) ;
      // NEVER exit while
@@ -601,19 +1851,75 @@ static PT_THREAD (protothread_anim1(struct pt *pt))
     PT_BEGIN(pt);
 
     // Variables for maintaining frame rate
-    static int begin_time ;
+    static pt_time_t begin_time ;
     static int spare_time ;
+#if VBLANK_PACING
+    static uint32_t begin_refresh ;
+#endif
+    // frame handshake with core 0 (see FRAME_SYNC)
+    static uint32_t fifo_msg ;
 
     // Spawn a boid
     // spawnBoid(&boid1_x, &boid1_y, &boid1_vx, &boid1_vy, 1);
 
+#if STAGE_TIMING
+    stage_init_core() ;
+#endif
+#if RENDER_MODE == RENDER_PIPELINE
+    // the first snapshot slot is free
+    PT_FIFO_WRITE(1) ;
+#endif
+
     while(1) {
       // Measure time at start of thread
-      begin_time = time_us_32() ;
-      parallel(flock,1) ;      
-      spare_time = FRAME_RATE - (time_us_32() - begin_time) ;
+      begin_time = PT_GET_TIME_usec64() ;
+#if VBLANK_PACING
+      begin_refresh = vga_frame_count ;
+#endif
+      TRACE(EV_FRAME_BEGIN, frames_drawn) ;
+#if FRAME_SYNC
+      // tell core 0 the previous frame is done and wait for it
+      // to resolve or clear the framebuffer and reset the chunks
+      PT_FIFO_WRITE(1) ;
+      TRACE(EV_WAIT_BEGIN, 0) ;
+      PT_FIFO_READ(fifo_msg) ;
+      TRACE(EV_WAIT_END, 0) ;
+#endif
+#if RENDER_MODE == RENDER_PIPELINE
+      // draw the frame core 0 finished and give the slot back
+      TRACE(EV_WAIT_BEGIN, 0) ;
+      PT_FIFO_READ(fifo_msg) ;
+      TRACE(EV_WAIT_END, 0) ;
+      STAGE_START() ;
+      clearParticles() ;
+      STAGE_MARK(STAGE_ERASE) ;
+      drawSnapshot(fifo_msg & 1, fifo_msg >> 1) ;
+      STAGE_MARK(STAGE_DRAW) ;
+      frames_drawn++ ;
+      PT_FIFO_WRITE(1) ;
+#else
+      parallel(flock,1) ;
+#endif
+#if RENDER_MODE == RENDER_TILED
+      // hand the physics to core 0 and wait for the bins
+      PT_FIFO_WRITE(1) ;
+      TRACE(EV_WAIT_BEGIN, 1) ;
+      PT_FIFO_READ(fifo_msg) ;
+      TRACE(EV_WAIT_END, 1) ;
+      STAGE_START() ;
+      rasterTiles(1) ;
+      STAGE_MARK(STAGE_DRAW) ;
+#endif
+      STAGE_FRAME_END(pt_sched_us[1]) ;
+      endHitFrame(1) ;
+      TRACE(EV_FRAME_END, frames_drawn) ;
+      spare_time = FRAME_RATE - (int)(PT_GET_TIME_usec64() - begin_time) ;
+#if VBLANK_PACING
+      PT_YIELD_UNTIL(pt, vga_frame_count - begin_refresh >= FRAME_VBLANKS) ;
+#else
       // yield for necessary amount of time
       PT_YIELD_usec(spare_time) ;
+#endif
      // NEVER exit while
     } // END WHILE(1)
   PT_END(pt);
@@ -623,12 +1929,16 @@ static PT_THREAD (protothread_anim1(struct pt *pt))
 // === core 1 main -- started in main below
 // ========================================
 void core1_main(){
-  // Add animation thread
-  pt_add_thread(protothread_anim1);
+  // Add animation thread (always runs first)
+  pt_add_thread_pri(protothread_anim1, 0);
   // Add information display on VGA
-  pt_add_thread(protothread_vga_information);
+  pt_add_thread_pri(protothread_vga_information, 6);
   // Mouse control
-  pt_add_thread(protothread_mouse_block);
+  pt_add_thread_pri(protothread_mouse_block, 4);
+  // Telemetry for the controller PC
+  pt_add_thread_pri(protothread_telemetry, 5);
+  // Framebuffer capture over USB
+  pt_add_thread_pri(protothread_capture, 7);
   // Start the scheduler
   pt_schedule_start ;
 
@@ -644,9 +1954,65 @@ int main(){
 
   // initialize stio
   stdio_init_all() ;
+  // USB CDC carries only the binary capture stream (sent straight to
+  // stdio_usb), so keep printf text from mixing into it
+  stdio_set_driver_enabled(&stdio_usb, false) ;
 
   // initialize VGA
-  initVGA() ;
+#if RENDER_MODE == RENDER_SCANLINE
+  initVGAScanline(HUD_BOTTOM, renderLine) ;
+#elif INDEXED_COLOR
+  initVGAIndexed(palette) ;
+#else
+  initVGAMode(LOW_RES ? VGA_320x240 : VGA_640x480) ;
+#endif
+
+#if RENDER_MODE == RENDER_DENSITY
+  initDensity() ;
+#elif RENDER_MODE == RENDER_CLEAR || RENDER_MODE == RENDER_PIPELINE
+  initClear() ;
+#endif
+#if WORK_STEALING
+  initWorkStealing() ;
+#endif
+  initCommands() ;
+  initCapture() ;
+#if STAGE_TIMING
+  stage_init() ;
+#endif
+#if EVENT_TRACE
+  trace_init() ;
+#endif
+
+  // the flock gets the rest of the main arena, so allocate it last
+#if RENDER_MODE == RENDER_TILED
+  max_boids = arena_free(ARENA_MAIN)/(sizeof(boid_slot) + TILE_BYTES_PER_BOID) ;
+  flock = arena_alloc(ARENA_MAIN, max_boids*sizeof(boid_slot), 4, "flock") ;
+  initTiles(max_boids) ;
+#elif RENDER_MODE == RENDER_PIPELINE
+  max_boids = arena_free(ARENA_MAIN)/(sizeof(boid_slot) + PIPE_BYTES_PER_BOID) ;
+  flock = arena_alloc(ARENA_MAIN, max_boids*sizeof(boid_slot), 4, "flock") ;
+  initPipeline(max_boids) ;
+#elif RENDER_MODE == RENDER_SCANLINE
+  max_boids = arena_free(ARENA_MAIN)/(sizeof(boid_slot) + SCAN_BYTES_PER_BOID) ;
+  flock = arena_alloc(ARENA_MAIN, max_boids*sizeof(boid_slot), 4, "flock") ;
+  initScanline(max_boids) ;
+#else
+  max_boids = arena_free(ARENA_MAIN)/sizeof(boid_slot) ;
+  flock = arena_alloc(ARENA_MAIN, max_boids*sizeof(boid_slot), 4, "flock") ;
+#endif
+  if (num_boids > max_boids) num_boids = max_boids ;
+  arena_report() ;
+#if BENCH_LAYOUT
+  benchmarkLayouts() ;
+#endif
+#if GOLDEN_RECORD
+  goldenRecord() ;
+#endif
+
+  // run threads by priority and deadline instead of round-robin
+  // (both cores read this, so set it before core 1 starts)
+  pt_sched_method = SCHED_PRIORITY ;
 
   // start core 1 
   multicore_reset_core1();
@@ -654,7 +2020,7 @@ int main(){
 
   // add threads
   // pt_add_thread(protothread_serial);
-  pt_add_thread(protothread_anim);
+  pt_add_thread_pri(protothread_anim, 0);
 
   // start scheduler
   pt_schedule_start ;
@@ -0,0 +1,54 @@
+// Header file
+#include "frame_capture.h"
+
+static inline void put16(unsigned char * b, int v)
+{
+  b[0] = v ;
+  b[1] = v >> 8 ;
+}
+
+int fcap_header(unsigned char * out, int seq, int width, int height, int flags)
+{
+  out[0] = 'V' ;
+  out[1] = 'F' ;
+  put16(out+2, seq) ;
+  put16(out+4, width) ;
+  put16(out+6, height) ;
+  out[8] = flags ;
+  return FCAP_HEADER_BYTES ;
+}
+
+int fcap_encode_line(unsigned char * out, int y, const unsigned char * line, int n)
+{
+  int len = 0 ;
+  unsigned char * rle = out + 4 ;
+  int i = 0 ;
+  while (i < n) {
+    unsigned char v = line[i] ;
+    int run = 1 ;
+    while (i + run < n && run < 255 && line[i + run] == v) run++ ;
+    rle[len++] = run ;
+    rle[len++] = v ;
+    i += run ;
+  }
+  put16(out, y) ;
+  put16(out+2, len) ;
+  return len + 4 ;
+}
+
+int fcap_end(unsigned char * out)
+{
+  put16(out, FCAP_END) ;
+  return 2 ;
+}
+
+// FNV-1a over 32-bit words
+unsigned int fcap_line_hash(const unsigned char * line, int n)
+{
+  const unsigned int * w = (const unsigned int *)line ;
+  unsigned int h = 2166136261u ;
+  for (int i = 0; i < n/4; i++) {
+    h = (h ^ w[i]) * 16777619u ;
+  }
+  return h ;
+}
@@ -0,0 +1,31 @@
+/**
+ * Framebuffer capture encoding
+ *
+ * A captured frame is sent as only the scanlines that changed since
+ * the last capture, each one run-length encoded. The encoder has no
+ * SDK dependencies, so the same code builds on a PC.
+ *
+ * STREAM (multi-byte fields little-endian)
+ *  - frame header: 'V', 'F', u16 sequence, u16 width, u16 height,
+ *                  u8 flags (FCAP_KEYFRAME: every line follows)
+ *  - line record:  u16 y, u16 n, then n bytes of (run, value) pairs
+ *                  that expand to the width/2 framebuffer bytes of
+ *                  the line
+ *  - end of frame: u16 FCAP_END
+ *  - pixels are packed as in vga_graphics.c: even x in bits 2:0,
+ *    odd x in bits 5:3, colors as enum colors
+ */
+
+#define FCAP_HEADER_BYTES 9
+#define FCAP_KEYFRAME 1
+#define FCAP_END 0xffff
+// longest line record for a line of n framebuffer bytes
+#define FCAP_LINE_MAX(n) (4 + 2*(n))
+
+// Capture encoding - usable in main
+int fcap_header(unsigned char * out, int seq, int width, int height, int flags) ;
+int fcap_encode_line(unsigned char * out, int y, const unsigned char * line, int n) ;
+int fcap_end(unsigned char * out) ;
+// Hash of a line to spot changes. line must be word aligned and n a
+// multiple of 4.
+unsigned int fcap_line_hash(const unsigned char * line, int n) ;
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "pico/stdlib.h"
+// Header file
+#include "mem_arena.h"
+
+// Maximum number of named allocations remembered for the report
+#define ARENA_MAX_ALLOCS 16
+
+// Backing storage for each region. The scratch regions sit below the
+// stacks in SRAM4/SRAM5, so keep ARENA_SCRATCH_SIZE well under 4k.
+static uint8_t arena_main[ARENA_MAIN_SIZE] __attribute__((aligned(4))) ;
+static uint8_t arena_scratch_x[ARENA_SCRATCH_SIZE] __attribute__((aligned(4))) __scratch_x("arena") ;
+static uint8_t arena_scratch_y[ARENA_SCRATCH_SIZE] __attribute__((aligned(4))) __scratch_y("arena") ;
+
+struct arena {
+  const char * name ;
+  uint8_t * base ;
+  size_t size ;
+  size_t used ;
+} ;
+
+static struct arena arenas[ARENA_NUM_REGIONS] = {
+  {"main (SRAM0-3)",    arena_main,      ARENA_MAIN_SIZE,    0},
+  {"scratch x (SRAM4)", arena_scratch_x, ARENA_SCRATCH_SIZE, 0},
+  {"scratch y (SRAM5)", arena_scratch_y, ARENA_SCRATCH_SIZE, 0},
+} ;
+
+// Allocation log for the startup report
+struct arena_alloc_entry {
+  const char * name ;
+  enum arena_region region ;
+  void * addr ;
+  size_t size ;
+} ;
+static struct arena_alloc_entry arena_allocs[ARENA_MAX_ALLOCS] ;
+static int arena_alloc_count = 0 ;
+
+// Linker symbols: end of .bss (start of heap) and top of the heap
+extern char end ;
+extern char __StackLimit ;
+
+void * arena_alloc(enum arena_region region, size_t size, size_t align, const char * name) {
+/* Hand out size bytes from a region
+ * Parameters:
+ *      region: which SRAM region to allocate from
+ *      size:   number of bytes
+ *      align:  required alignment (power of two, 0 or 1 for none)
+ *      name:   label used by arena_report()
+ * Returns: pointer to the block, or NULL if the region is full
+ */
+  struct arena * a = &arenas[region] ;
+  size_t offset = a->used ;
+  if (align > 1) {
+    offset = (offset + align - 1) & ~(align - 1) ;
+  }
+  if (offset + size > a->size) {
+    printf("arena: %s cannot fit %s (%u bytes, %u free)\n\r",
+           a->name, name, (unsigned)size, (unsigned)(a->size - a->used)) ;
+    return NULL ;
+  }
+  a->used = offset + size ;
+  if (arena_alloc_count < ARENA_MAX_ALLOCS) {
+    arena_allocs[arena_alloc_count].name = name ;
+    arena_allocs[arena_alloc_count].region = region ;
+    arena_allocs[arena_alloc_count].addr = a->base + offset ;
+    arena_allocs[arena_alloc_count].size = size ;
+    arena_alloc_count++ ;
+  }
+  return a->base + offset ;
+}
+
+size_t arena_free(enum arena_region region) {
+  return arenas[region].size - arenas[region].used ;
+}
+
+void arena_report(void) {
+/* Print used/free bytes for every region, every allocation,
+ * and the static data and heap headroom outside the arena
+ */
+  printf("=== SRAM budget ===\n\r") ;
+  for (int r = 0; r < ARENA_NUM_REGIONS; r++) {
+    printf("%-18s used %6u free %6u of %6u\n\r", arenas[r].name,
+           (unsigned)arenas[r].used, (unsigned)arena_free(r), (unsigned)arenas[r].size) ;
+    for (int i = 0; i < arena_alloc_count; i++) {
+      if (arena_allocs[i].region == r) {
+        printf("  %-16s %p %6u\n\r", arena_allocs[i].name,
+               arena_allocs[i].addr, (unsigned)arena_allocs[i].size) ;
+      }
+    }
+  }
+  // everything below 'end' that is not the arena is .data/.bss
+  printf("%-18s %6u\n\r", "static data/bss",
+         (unsigned)((uintptr_t)&end - SRAM_BASE - ARENA_MAIN_SIZE)) ;
+  printf("%-18s %6u\n\r", "heap headroom",
+         (unsigned)((uintptr_t)&__StackLimit - (uintptr_t)&end)) ;
+}
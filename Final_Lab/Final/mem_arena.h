@@ -0,0 +1,37 @@
+/**
+ * Static SRAM arena for the particle system
+ *
+ * All large buffers (framebuffer, particle pools, scratch buffers)
+ * are handed out from statically reserved regions instead of being
+ * declared as separate globals, so the whole memory budget is
+ * visible in one place and can be reported at startup.
+ *
+ * REGIONS
+ *  - ARENA_MAIN      SRAM0-3 (striped 256 kBytes, shared by both cores
+ *                    and the scan-out DMA). Framebuffer and particles.
+ *  - ARENA_SCRATCH_X SRAM4 (4 kBytes, also holds the core 1 stack).
+ *                    Small buffers that only core 1 touches.
+ *  - ARENA_SCRATCH_Y SRAM5 (4 kBytes, also holds the core 0 stack).
+ *                    Small buffers that only core 0 touches.
+ *
+ * NOTE
+ *  - Allocation is a bump pointer with no free. Allocate everything
+ *    from core 0 before core 1 is launched.
+ *  - Whatever should get "the rest" of a region (the flock) must be
+ *    allocated last.
+ */
+
+#include <stddef.h>
+
+enum arena_region {ARENA_MAIN, ARENA_SCRATCH_X, ARENA_SCRATCH_Y, ARENA_NUM_REGIONS} ;
+
+// Region sizes. ARENA_MAIN leaves ARENA_MAIN_RESERVE bytes of the
+// striped SRAM for .data/.bss (thread tables, serial buffers) and heap.
+#define ARENA_MAIN_RESERVE 16384
+#define ARENA_MAIN_SIZE    (262144 - ARENA_MAIN_RESERVE)
+#define ARENA_SCRATCH_SIZE 1024
+
+// Arena primitives - usable in main
+void * arena_alloc(enum arena_region region, size_t size, size_t align, const char * name) ;
+size_t arena_free(enum arena_region region) ;
+void arena_report(void) ;
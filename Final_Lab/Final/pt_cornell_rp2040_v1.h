@@ -464,6 +464,31 @@ struct pt {
     }           \
   } while(0)
 
+/**
+ * \brief      Yield until a condition occurs, sleeping on wake sources.
+ * \param pt   A pointer to the protothread control structure.
+ * \param cond The condition.
+ * \param events The PT_WAKE_ sources that can make cond true.
+ *
+ *             Same as PT_YIELD_UNTIL(), but under SCHED_PRIORITY the
+ *             thread is not called again until one of the events
+ *             fires, instead of being polled every pass. The
+ *             events are edges (one interrupt can queue many UART
+ *             bytes), so the thread only blocks while cond is false;
+ *             when it already holds, this is a plain yield.
+ *
+ * \hideinitializer
+ */
+#define PT_YIELD_UNTIL_EVENT(pt, cond, events)    \
+  do {            \
+    PT_YIELD_FLAG = 0;        \
+    LC_SET((pt)->lc);       \
+    if((PT_YIELD_FLAG == 0) || !(cond)) { \
+      if (!(cond)) pt_wait_event(events);       \
+      return PT_YIELDED;                        \
+    }           \
+  } while(0)
+
 /** @} */
 
 #endif /* __PT_H__ */
@@ -541,25 +566,42 @@ struct pt_sem {
 //=== BRL4 additions for rp2040 =======================================
 //=====================================================================
 
+// === wraparound-safe time =========================================
+// timerawl is 32 bits of usec and wraps every ~71 minutes, so
+// deadlines are kept in 64-bit time (time_us_64 never wraps in
+// practice) and compared through the signed difference, which also
+// keeps 32-bit timestamps correct across a wrap.
+typedef unsigned long long pt_time_t ;
+// true once time a is at or after time b
+#define PT_TIME_AFTER(a, b)   ((long long)((a) - (b)) >= 0)
+#define PT_TIME_AFTER32(a, b) ((int)((unsigned int)(a) - (unsigned int)(b)) >= 0)
+// true once the clock reaches deadline
+#define PT_TIME_REACHED(deadline) PT_TIME_AFTER(time_us_64(), (deadline))
+
 // macro to make a thread execution pause in usec
-// max time of about one hour
+// (also tells the priority scheduler when to run the thread again)
+// A negative delay means the caller overran its time budget: the
+// thread just yields once and the overrun is counted for it.
 #define PT_YIELD_usec(delay_time)  \
-    do { static unsigned int time_thread ;\
-    time_thread = timer_hw->timerawl + (unsigned int)delay_time ; \
-    PT_YIELD_UNTIL(pt, (timer_hw->timerawl >= time_thread)); \
+    do { static pt_time_t time_thread ;\
+    time_thread = pt_deadline_usec((int)(delay_time)) ; \
+    pt_sleep_until(time_thread) ; \
+    PT_YIELD_UNTIL(pt, PT_TIME_REACHED(time_thread)); \
     } while(0);
 
 // macro to return system time
 #define PT_GET_TIME_usec() (timer_hw->timerawl)
+#define PT_GET_TIME_usec64() (time_us_64())
 
 // macros for interval yield
 // attempts to make interval equal to specified value
-#define PT_INTERVAL_INIT() static unsigned int pt_interval_marker
+#define PT_INTERVAL_INIT() static pt_time_t pt_interval_marker
 //
 #define PT_YIELD_INTERVAL(interval_time)  \
     do { \
-    PT_YIELD_UNTIL(pt, (timer_hw->timerawl >= pt_interval_marker)); \
-    pt_interval_marker = timer_hw->timerawl + (unsigned int)interval_time; \
+    pt_sleep_until(pt_interval_marker) ; \
+    PT_YIELD_UNTIL(pt, PT_TIME_REACHED(pt_interval_marker)); \
+    pt_interval_marker = time_us_64() + (unsigned int)interval_time; \
     } while(0);
 //
 // =================================================================
@@ -641,7 +683,7 @@ spin_lock_t * lock_lock ;
 
 #define PT_FIFO_READ(fifo_out)  \
 do{ \
-    PT_YIELD_UNTIL(pt, multicore_fifo_rvalid()==true); \
+    PT_YIELD_UNTIL_EVENT(pt, multicore_fifo_rvalid()==true, PT_WAKE_FIFO); \
     fifo_out = multicore_fifo_pop_blocking() ; \
 } while(0) 
 
@@ -670,8 +712,29 @@ struct ptx {
   struct pt pt;              // thread context
   int num;                    // thread number
   char (*pf)(struct pt *pt); // pointer to thread function
+  int pri;                    // priority, lower runs first (SCHED_PRIORITY)
+  int rank;                   // position in the core's run order
+  pt_time_t wake;             // wake time while sleeping, usec
+  char sleeping;              // on the wait list
+  unsigned char wait_on;      // PT_WAKE_ events the thread is blocked on
+  unsigned int wakes[3];      // times woken by the timer, UART and FIFO
+  const char *name;           // for the stats report
+  unsigned int calls;         // number of times the scheduler called it
+  unsigned long long total_us; // cumulative run time
+  unsigned int max_us;        // longest single call
+  unsigned int overruns;      // PT_YIELD_usec called with a negative delay
 };
 
+// wake sources for SCHED_PRIORITY
+#define PT_WAKE_TIMER 1
+#define PT_WAKE_UART  2
+#define PT_WAKE_FIFO  4
+// events raised by interrupt handlers, per core
+static volatile unsigned char pt_events[2] ;
+
+// default priority for threads added with pt_add_thread
+#define PT_PRI_DEFAULT 8
+
 // === extended structure for scheduler ===============
 // an array of task structures
 #define MAX_THREADS 10
@@ -679,11 +742,33 @@ static struct ptx pt_thread_list[MAX_THREADS];
 // core 1
 static struct ptx pt_thread_list1[MAX_THREADS];
 
+// === priority scheduler state (per core) ===
+// thread indices in run order (sorted by priority when added)
+static unsigned char pt_run_order[2][MAX_THREADS] ;
+// sleeping threads sorted by wake time, earliest first
+static unsigned char pt_wait_list[2][MAX_THREADS] ;
+static int pt_wait_count[2] ;
+// thread the scheduler is running right now on each core
+static struct ptx * pt_current[2] ;
+
+// insert a new thread into a core's run order by priority
+// (stable, so equal priorities keep the order they were added)
+void pt_insert_run_order(struct ptx *list, int count, int core) {
+  unsigned char *order = pt_run_order[core] ;
+  int k = count - 1 ;
+  while (k > 0 && list[order[k-1]].pri > list[count-1].pri) {
+    order[k] = order[k-1] ;
+    k-- ;
+  }
+  order[k] = count - 1 ;
+  for (k = 0; k < count; k++) list[order[k]].rank = k ;
+}
+
 // see https://github.com/edartuz/c-ptx/tree/master/src
 // and the license above
 // add an entry to the thread list
 //struct ptx *pt_add( char (*pf)(struct pt *pt), int rate) {
-int pt_add( char (*pf)(struct pt *pt)) {
+int pt_add_pri( char (*pf)(struct pt *pt), int pri, const char *name) {
   if (pt_task_count < (MAX_THREADS)) {
         // get the current thread table entry 
     struct ptx *ptx = &pt_thread_list[pt_task_count];
@@ -691,19 +776,33 @@ int pt_add( char (*pf)(struct pt *pt)) {
     ptx->num   = pt_task_count;
         // function pointer
     ptx->pf    = pf;
+    ptx->pri   = pri;
+    ptx->name  = name;
+    ptx->sleeping = 0;
+    ptx->wait_on = 0;
+    ptx->calls = 0;
+    ptx->total_us = 0;
+    ptx->max_us = 0;
+    ptx->overruns = 0;
+    ptx->wakes[0] = ptx->wakes[1] = ptx->wakes[2] = 0;
     //
     PT_INIT( &ptx->pt );
         // count of number of defined threads
     pt_task_count++;
+    pt_insert_run_order(pt_thread_list, pt_task_count, 0);
         // return current entry
         return pt_task_count-1;
   }
   return 0;
 }
 
+int pt_add( char (*pf)(struct pt *pt)) {
+  return pt_add_pri(pf, PT_PRI_DEFAULT, "");
+}
+
 // core 1 -- add an entry to the thread list
 //struct ptx *pt_add( char (*pf)(struct pt *pt), int rate) {
-int pt_add1( char (*pf)(struct pt *pt)) {
+int pt_add1_pri( char (*pf)(struct pt *pt), int pri, const char *name) {
   if (pt_task_count1 < (MAX_THREADS)) {
         // get the current thread table entry 
     struct ptx *ptx = &pt_thread_list1[pt_task_count1];
@@ -711,16 +810,30 @@ int pt_add1( char (*pf)(struct pt *pt)) {
     ptx->num   = pt_task_count1;
         // function pointer
     ptx->pf    = pf;
+    ptx->pri   = pri;
+    ptx->name  = name;
+    ptx->sleeping = 0;
+    ptx->wait_on = 0;
+    ptx->calls = 0;
+    ptx->total_us = 0;
+    ptx->max_us = 0;
+    ptx->overruns = 0;
+    ptx->wakes[0] = ptx->wakes[1] = ptx->wakes[2] = 0;
     //
     PT_INIT( &ptx->pt );
         // count of number of defined threads
     pt_task_count1++;
+    pt_insert_run_order(pt_thread_list1, pt_task_count1, 1);
         // return current entry
         return pt_task_count1-1;
   }
   return 0;
 }
 
+int pt_add1( char (*pf)(struct pt *pt)) {
+  return pt_add1_pri(pf, PT_PRI_DEFAULT, "");
+}
+
 /* Scheduler
 Copyright (c) 2014 edartuz
 
@@ -748,11 +861,200 @@ SOFTWARE.
 // https://github.com/edartuz/c-ptx
 // see license above
 
+// === per-thread CPU time accounting ===================================
+// every scheduler call is timed: call count, total and max run time.
+// pt_idle_us is the time each core spent sleeping in pt_idle(),
+// pt_sched_us the time spent in the scheduler itself (between thread
+// calls, not sleeping).
+static unsigned long long pt_idle_us[2] ;
+unsigned long long pt_sched_us[2] ;
+static unsigned int pt_last_exit[2] ;
+
+// tracer hooks, an application tracer defines these before
+// including this file (see event_trace.h)
+#ifndef PT_TRACE_ENTER
+#define PT_TRACE_ENTER(num)
+#define PT_TRACE_EXIT(num)
+#define PT_TRACE_DMA(chan)
+#endif
+
+static inline void pt_run_thread(struct ptx *ptx) {
+  uint core = get_core_num() ;
+  unsigned int start = timer_hw->timerawl ;
+  if (pt_last_exit[core]) pt_sched_us[core] += start - pt_last_exit[core] ;
+  PT_TRACE_ENTER(ptx->num) ;
+  // set for both schedulers, so overruns count under round-robin too
+  pt_current[core] = ptx ;
+  (ptx->pf)(&ptx->pt) ;
+  pt_current[core] = NULL ;
+  PT_TRACE_EXIT(ptx->num) ;
+  unsigned int end = timer_hw->timerawl ;
+  pt_last_exit[core] = end ;
+  unsigned int run = end - start ;
+  ptx->calls++ ;
+  ptx->total_us += run ;
+  if (run > ptx->max_us) ptx->max_us = run ;
+}
+
+// format thread i of a core for the serial/VGA report into buf, with
+// w: the wakes by timer/UART/FIFO under SCHED_PRIORITY
+// (size bytes, the line is cut short to fit), returns 0 past the
+// last thread
+int pt_stats_line(char *buf, int size, int core, int i) {
+  int count = core ? pt_task_count1 : pt_task_count ;
+  if (i >= count) return 0 ;
+  struct ptx *ptx = core ? &pt_thread_list1[i] : &pt_thread_list[i] ;
+  const char *name = ptx->name ;
+  // drop the common prefix to keep lines short
+  if (strncmp(name, "protothread_", 12) == 0) name += 12 ;
+  snprintf(buf, size, "c%d %-12.12s n:%-7u avg:%-5u max:%-6u ovr:%u w:%u/%u/%u\n\r", core, name, ptx->calls,
+          ptx->calls ? (unsigned int)(ptx->total_us / ptx->calls) : 0, ptx->max_us, ptx->overruns,
+          ptx->wakes[0], ptx->wakes[1], ptx->wakes[2]) ;
+  return 1 ;
+}
+
+// clear the counters of both cores
+void pt_stats_reset(void) {
+  for (int i = 0; i < pt_task_count; i++) {
+    pt_thread_list[i].calls = 0 ; pt_thread_list[i].total_us = 0 ; pt_thread_list[i].max_us = 0 ;
+    pt_thread_list[i].overruns = 0 ;
+    memset(pt_thread_list[i].wakes, 0, sizeof(pt_thread_list[i].wakes)) ;
+  }
+  for (int i = 0; i < pt_task_count1; i++) {
+    pt_thread_list1[i].calls = 0 ; pt_thread_list1[i].total_us = 0 ; pt_thread_list1[i].max_us = 0 ;
+    pt_thread_list1[i].overruns = 0 ;
+    memset(pt_thread_list1[i].wakes, 0, sizeof(pt_thread_list1[i].wakes)) ;
+  }
+  pt_idle_us[0] = pt_idle_us[1] = 0 ;
+}
+
 // choose schedule method
 #define SCHED_ROUND_ROBIN 0
 #define SCHED_RATE 1
+#define SCHED_PRIORITY 2
 int pt_sched_method = SCHED_ROUND_ROBIN ;
 
+// === priority scheduler ===============================================
+// Ready threads run in priority order. A thread that yields with
+// PT_YIELD_usec/PT_YIELD_INTERVAL goes onto a wait list sorted by wake
+// time and is not called at all until that time, so a sleeping thread
+// costs one compare against the head of the list per pass. After each
+// thread returns, the pass restarts if a higher priority thread woke
+// up meanwhile, so it waits for at most one lower priority call.
+
+// called from PT_YIELD_usec: deadline delay usec from now, with
+// a negative delay counted as an overrun of the running thread
+pt_time_t pt_deadline_usec(int delay) {
+  if (delay < 0) {
+    struct ptx *ptx = pt_current[get_core_num()] ;
+    if (ptx != NULL) ptx->overruns++ ;
+    delay = 0 ;
+  }
+  return time_us_64() + (unsigned int)delay ;
+}
+
+// called from the yield macros: put the running thread to sleep
+void pt_sleep_until(pt_time_t wake) {
+  int core = get_core_num() ;
+  struct ptx *ptx = pt_current[core] ;
+  if (pt_sched_method != SCHED_PRIORITY || ptx == NULL) return ;
+  unsigned char *wait = pt_wait_list[core] ;
+  struct ptx *list = core ? pt_thread_list1 : pt_thread_list ;
+  // insertion sort by wake time
+  int k = pt_wait_count[core] ;
+  while (k > 0 && !PT_TIME_AFTER(wake, list[wait[k-1]].wake)) {
+    wait[k] = wait[k-1] ;
+    k-- ;
+  }
+  wait[k] = ptx->num ;
+  pt_wait_count[core]++ ;
+  ptx->wake = wake ;
+  ptx->sleeping = 1 ;
+}
+
+// move threads whose wake time has passed back to ready,
+// returns the best (lowest) rank that woke, or MAX_THREADS
+int pt_wake_expired(struct ptx *list, int core) {
+  unsigned char *wait = pt_wait_list[core] ;
+  pt_time_t now = time_us_64() ;
+  int woke = 0, best = MAX_THREADS ;
+  while (woke < pt_wait_count[core] && PT_TIME_AFTER(now, list[wait[woke]].wake)) {
+    struct ptx *ptx = &list[wait[woke]] ;
+    ptx->sleeping = 0 ;
+    ptx->wakes[0]++ ;
+    if (ptx->rank < best) best = ptx->rank ;
+    woke++ ;
+  }
+  if (woke) {
+    pt_wait_count[core] -= woke ;
+    for (int k = 0; k < pt_wait_count[core]; k++) wait[k] = wait[k+woke] ;
+  }
+  return best ;
+}
+
+// one pass over the ready threads of a core,
+// returns the number of threads that ran
+int pt_priority_pass(struct ptx *list, int count, int core) {
+  unsigned char *order = pt_run_order[core] ;
+  int ran = 0 ;
+  pt_wake_expired(list, core) ;
+  for (int k = 0; k < count; k++) {
+    struct ptx *ptx = &list[order[k]] ;
+    if (ptx->sleeping) continue ;
+    if (ptx->wait_on) {
+      // blocked until one of its events fires. The UART and FIFO
+      // interrupts set bits here too, so test and clear with them
+      // off or a wakeup landing in between is lost
+      uint32_t irq_state = save_and_disable_interrupts() ;
+      unsigned char ev = pt_events[core] & ptx->wait_on ;
+      pt_events[core] &= ~ev ;
+      restore_interrupts(irq_state) ;
+      if (!ev) continue ;
+      if (ev & PT_WAKE_UART) ptx->wakes[1]++ ;
+      if (ev & PT_WAKE_FIFO) ptx->wakes[2]++ ;
+      ptx->wait_on = 0 ;
+    }
+    pt_run_thread(ptx) ;
+    ran++ ;
+    // restart from a higher priority thread that just woke up
+    int best = pt_wake_expired(list, core) ;
+    if (best <= k) k = best - 1 ;
+  }
+  return ran ;
+}
+
+// === idle: sleep until the next wake time or interrupt ===
+// When no thread is ready, arm a hardware alarm for the earliest wake
+// time on the wait list and __wfe() until it (or a UART/FIFO interrupt)
+// fires, instead of hammering the bus fabric the scan-out DMA uses.
+// Shorter waits than this are just spun.
+#define PT_IDLE_MIN_usec 20
+static int pt_alarm[2] = {-1, -1} ;
+
+// the interrupt itself is what wakes __wfe()
+static void pt_alarm_callback(uint alarm_num) {
+}
+
+void pt_idle(struct ptx *list, int core) {
+  if (pt_alarm[core] < 0) {
+    // claim from this core so the alarm interrupt is taken here
+    pt_alarm[core] = hardware_alarm_claim_unused(true) ;
+    hardware_alarm_set_callback(pt_alarm[core], pt_alarm_callback) ;
+  }
+  if (pt_wait_count[core] > 0) {
+    pt_time_t wake = list[pt_wait_list[core][0]].wake ;
+    if (PT_TIME_AFTER(time_us_64() + PT_IDLE_MIN_usec, wake)) return ;
+    // a missed target means the time has already passed
+    if (hardware_alarm_set_target(pt_alarm[core], from_us_since_boot(wake))) return ;
+  }
+  // any interrupt taken since the pass also sets the event register,
+  // so this returns at once if something became ready meanwhile
+  unsigned int start = timer_hw->timerawl ;
+  __wfe() ;
+  pt_last_exit[core] = timer_hw->timerawl ;
+  pt_idle_us[core] += pt_last_exit[core] - start ;
+}
+
 static PT_THREAD (protothread_sched(struct pt *pt))
 {   
     PT_BEGIN(pt);
@@ -768,12 +1070,19 @@ static PT_THREAD (protothread_sched(struct pt *pt))
           // -- separated using comma operator. But it can have only one condition.
           for (i=0; i<pt_task_count; i++, ptx++ ){
               // call thread function
-              (pt_thread_list[i].pf)(&ptx->pt); 
+              pt_run_thread(ptx); 
           }
           // Never yields! 
           // NEVER exit while!
         } // END WHILE(1)
     } //end if (pt_sched_method==RR)       
+    else if (pt_sched_method==SCHED_PRIORITY){
+        while(1) {
+          if (!pt_priority_pass(pt_thread_list, pt_task_count, 0)) pt_idle(pt_thread_list, 0);
+          // Never yields! 
+          // NEVER exit while!
+        } // END WHILE(1)
+    } //end if (pt_sched_method==SCHED_PRIORITY)
      
     PT_END(pt);
 } // scheduler thread
@@ -796,12 +1105,19 @@ static PT_THREAD (protothread_sched1(struct pt *pt))
           // -- separated using comma operator. But it can have only one condition.
           for (i=0; i<pt_task_count1; i++, ptx++ ){
               // call thread function
-              (pt_thread_list1[i].pf)(&ptx->pt); 
+              pt_run_thread(ptx); 
           }
           // Never yields! 
           // NEVER exit while!
         } // END WHILE(1)
     } // end if(pt_sched_method==SCHED_ROUND_ROBIN)      
+    else if (pt_sched_method==SCHED_PRIORITY){
+        while(1) {
+          if (!pt_priority_pass(pt_thread_list1, pt_task_count1, 1)) pt_idle(pt_thread_list1, 1);
+          // Never yields! 
+          // NEVER exit while!
+        } // END WHILE(1)
+    } // end if(pt_sched_method==SCHED_PRIORITY)
      
     PT_END(pt);
 } // scheduler1 thread
@@ -821,9 +1137,18 @@ static PT_THREAD (protothread_sched1(struct pt *pt))
 // === package the add thread ==========================
 #define pt_add_thread(thread_name) do{\
   if(get_core_num()==1){ \
-    pt_add1(thread_name);\
+    pt_add1_pri(thread_name, PT_PRI_DEFAULT, #thread_name);\
   }  else {\
-    pt_add(thread_name);\
+    pt_add_pri(thread_name, PT_PRI_DEFAULT, #thread_name);\
+  }\
+} while(0) 
+
+// with a priority for SCHED_PRIORITY (lower runs first)
+#define pt_add_thread_pri(thread_name, pri) do{\
+  if(get_core_num()==1){ \
+    pt_add1_pri(thread_name, pri, #thread_name);\
+  }  else {\
+    pt_add_pri(thread_name, pri, #thread_name);\
   }\
 } while(0) 
 
@@ -839,6 +1164,117 @@ static struct pt pt_serialin, pt_serialout ;
 //
 #define pt_backspace 0x7f // make sure your backspace matches this!
 //
+// === UART receive ring ===================================
+// The RX interrupt moves every received character into a ring buffer
+// and raises PT_WAKE_UART on the core that installed it (the first
+// one to read). The interrupt is the only writer of pt_rx_head and
+// the reader the only writer of pt_rx_tail, so no lock is needed as
+// long as the readers stay on that core. Characters arriving with the
+// ring full are counted in pt_rx_dropped.
+#define PT_RX_SIZE 256  // power of 2
+static char pt_rx_buf[PT_RX_SIZE] ;
+static volatile unsigned int pt_rx_head, pt_rx_tail ;
+volatile unsigned int pt_rx_dropped ;
+static char pt_rx_installed ;
+
+static void pt_uart_irq(void) {
+  while (uart_is_readable(UART_ID)) {
+    char ch = uart_getc(UART_ID) ;
+    unsigned int head = pt_rx_head ;
+    if (head - pt_rx_tail < PT_RX_SIZE) {
+      pt_rx_buf[head & (PT_RX_SIZE-1)] = ch ;
+      pt_rx_head = head + 1 ;
+    } else {
+      pt_rx_dropped++ ;
+    }
+  }
+  pt_events[get_core_num()] |= PT_WAKE_UART ;
+}
+
+static void pt_uart_rx_init(void) {
+  uint irq = (UART_ID == uart0) ? UART0_IRQ : UART1_IRQ ;
+  irq_set_exclusive_handler(irq, pt_uart_irq) ;
+  irq_set_enabled(irq, true) ;
+  uart_set_irq_enables(UART_ID, true, false) ;
+  pt_rx_installed = 1 ;
+}
+
+// characters waiting in the ring (use as the PT_WAKE_UART condition)
+static inline int pt_uart_readable(void) {
+  if (!pt_rx_installed) pt_uart_rx_init() ;
+  return pt_rx_head != pt_rx_tail ;
+}
+
+// next character, only after pt_uart_readable()
+static inline char pt_uart_getc(void) {
+  unsigned int tail = pt_rx_tail ;
+  char ch = pt_rx_buf[tail & (PT_RX_SIZE-1)] ;
+  pt_rx_tail = tail + 1 ;
+  return ch ;
+}
+
+// === UART transmit DMA ===================================
+// serial_write copies pt_serial_out_buffer to a staging buffer and
+// starts a DMA transfer into the UART, so the caller can reuse the
+// buffer at once. The next write (or echo) waits for it to finish.
+static char pt_serial_tx_buffer[pt_buffer_size] ;
+static int pt_tx_chan = -1 ;
+
+static void pt_uart_tx_init(void) {
+  pt_tx_chan = dma_claim_unused_channel(true) ;
+  dma_channel_config c = dma_channel_get_default_config(pt_tx_chan) ;
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8) ;
+  channel_config_set_read_increment(&c, true) ;
+  channel_config_set_write_increment(&c, false) ;
+  channel_config_set_dreq(&c, uart_get_dreq(UART_ID, true)) ;
+  dma_channel_configure(pt_tx_chan, &c, &uart_get_hw(UART_ID)->dr,
+                        pt_serial_tx_buffer, 0, false) ;
+}
+
+static inline int pt_uart_tx_idle(void) {
+  return pt_tx_chan < 0 || !dma_channel_is_busy(pt_tx_chan) ;
+}
+
+// start sending n bytes of buf (binary is fine), only when
+// pt_uart_tx_idle(). Does not wait for the transfer.
+static void pt_serial_send(const char * buf, int n) {
+  if (pt_tx_chan < 0) pt_uart_tx_init() ;
+  if (n > pt_buffer_size) n = pt_buffer_size ;
+  memcpy(pt_serial_tx_buffer, buf, n) ;
+  PT_TRACE_DMA(pt_tx_chan) ;
+  dma_channel_transfer_from_buffer_now(pt_tx_chan, pt_serial_tx_buffer, n) ;
+}
+
+// === wake sources ========================================
+// The SIO FIFO interrupt only raises an event for the core that armed
+// it and masks itself; the thread that waits again re-arms it. Data
+// stays in the hardware FIFO.
+static void pt_fifo_irq(void) {
+  uint core = get_core_num() ;
+  irq_set_enabled(core ? SIO_IRQ_PROC1 : SIO_IRQ_PROC0, false) ;
+  pt_events[core] |= PT_WAKE_FIFO ;
+}
+
+// called from PT_YIELD_UNTIL_EVENT: block the running thread on events
+void pt_wait_event(unsigned char events) {
+  static char fifo_installed[2] ;
+  uint core = get_core_num() ;
+  struct ptx *ptx = pt_current[core] ;
+  if (pt_sched_method != SCHED_PRIORITY || ptx == NULL) return ;
+  ptx->wait_on = events ;
+  if ((events & PT_WAKE_UART) && !pt_rx_installed) {
+    pt_uart_rx_init() ;
+  }
+  if (events & PT_WAKE_FIFO) {
+    uint irq = core ? SIO_IRQ_PROC1 : SIO_IRQ_PROC0 ;
+    if (!fifo_installed[core]) {
+      irq_set_exclusive_handler(irq, pt_fifo_irq) ;
+      fifo_installed[core] = 1 ;
+    }
+    irq_set_enabled(irq, true) ;
+  }
+}
+
 static PT_THREAD (pt_serialin_polled(struct pt *pt)){
     PT_BEGIN(pt);
       static uint8_t ch ;
@@ -846,15 +1282,14 @@ static PT_THREAD (pt_serialin_polled(struct pt *pt)){
       // clear the string
       memset(pt_serial_in_buffer, 0, pt_buffer_size);
       pt_current_char_count = 0 ;
-      // clear uart fifo
-      while(uart_is_readable(UART_ID)){uart_getc(UART_ID);}
-      // build the output string
+      // build the output string (characters typed ahead are kept)
       while(pt_current_char_count < pt_buffer_size) {   
-        PT_YIELD_UNTIL(pt, (int)uart_is_readable(UART_ID)) ;
+        PT_YIELD_UNTIL_EVENT(pt, pt_uart_readable(), PT_WAKE_UART) ;
         //get the character and echo it back to terminal
         // NOTE this assumes a human is typing!!
-        ch = uart_getc(UART_ID);
-        PT_YIELD_UNTIL(pt, (int)uart_is_writable(UART_ID)) ;
+        ch = pt_uart_getc();
+        // don't cut into a prompt still going out by DMA
+        PT_YIELD_UNTIL(pt, pt_uart_tx_idle() && (int)uart_is_writable(UART_ID)) ;
         uart_putc(UART_ID, ch);
         // check for <enter> or <backspace>
         if (ch == '\r' ){
@@ -892,14 +1327,10 @@ static PT_THREAD (pt_serialin_polled(struct pt *pt)){
 //
 int pt_serialout_polled(struct pt *pt)
 {
-    static int num_send_chars ;
     PT_BEGIN(pt);
-    num_send_chars = 0;
-    while (pt_serial_out_buffer[num_send_chars] != 0){
-        PT_YIELD_UNTIL(pt, (int)uart_is_writable(UART_ID)) ;
-        uart_putc(UART_ID, pt_serial_out_buffer[num_send_chars]) ;
-        num_send_chars++;
-    }
+    // wait out the previous string, then hand this one to the DMA
+    PT_YIELD_UNTIL(pt, pt_uart_tx_idle()) ;
+    pt_serial_send(pt_serial_out_buffer, strlen(pt_serial_out_buffer)) ;
     // kill this output thread, to allow spawning thread to execute
     PT_EXIT(pt);
     // and indicate the end of the thread
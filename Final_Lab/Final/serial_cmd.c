@@ -0,0 +1,79 @@
+// Header file
+#include "serial_cmd.h"
+
+// parser states
+enum {WAIT_SYNC, WAIT_ID, WAIT_LEN, WAIT_PAYLOAD, WAIT_CHECK} ;
+
+void cmd_init(struct cmd_parser * p)
+{
+  p->state = WAIT_SYNC ;
+  p->last_us = 0 ;
+  p->errors = 0 ;
+}
+
+int cmd_busy(const struct cmd_parser * p)
+{
+  return p->state != WAIT_SYNC ;
+}
+
+void cmd_expire(struct cmd_parser * p, unsigned int now_us)
+{
+  if (p->state != WAIT_SYNC && now_us - p->last_us > CMD_TIMEOUT_US) {
+    p->errors++ ;
+    p->state = WAIT_SYNC ;
+  }
+  p->last_us = now_us ;
+}
+
+int cmd_feed(struct cmd_parser * p, unsigned char byte)
+{
+  switch (p->state) {
+    case WAIT_SYNC:
+      if (byte == CMD_SYNC) p->state = WAIT_ID ;
+      return 0 ;
+    case WAIT_ID:
+      // no command or reply has this id, a new frame started
+      if (byte == CMD_SYNC) return 0 ;
+      p->frame.id = byte ;
+      p->check = byte ;
+      p->state = WAIT_LEN ;
+      return 0 ;
+    case WAIT_LEN:
+      if (byte > CMD_MAX_PAYLOAD) {
+        p->errors++ ;
+        p->state = WAIT_SYNC ;
+        return 0 ;
+      }
+      p->frame.len = byte ;
+      p->check ^= byte ;
+      p->pos = 0 ;
+      p->state = byte ? WAIT_PAYLOAD : WAIT_CHECK ;
+      return 0 ;
+    case WAIT_PAYLOAD:
+      p->frame.payload[p->pos++] = byte ;
+      p->check ^= byte ;
+      if (p->pos == p->frame.len) p->state = WAIT_CHECK ;
+      return 0 ;
+    default:
+      p->state = WAIT_SYNC ;
+      if (byte != p->check) {
+        p->errors++ ;
+        return 0 ;
+      }
+      return 1 ;
+  }
+}
+
+int cmd_encode(unsigned char * out, unsigned char id, const unsigned char * payload, int len)
+{
+  unsigned char check = id ^ len ;
+  out[0] = CMD_SYNC ;
+  out[1] = id ;
+  out[2] = len ;
+  for (int i = 0; i<len; i++) {
+    out[3+i] = payload[i] ;
+    check ^= payload[i] ;
+  }
+  out[3+len] = check ;
+  return len + 4 ;
+}
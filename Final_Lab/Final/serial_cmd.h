@@ -0,0 +1,75 @@
+/**
+ * Framed binary command protocol for scene control and telemetry
+ *
+ * A controller PC drives the simulation over the same UART as the
+ * key commands. Frames start with a byte that never appears in typed
+ * text, so keys and frames can share the link.
+ *
+ * FRAME
+ *  - CMD_SYNC, id, len, payload[len], check
+ *  - check is the XOR of id, len and the payload bytes
+ *  - multi-byte payload fields are little-endian
+ *  - replies and telemetry use id | CMD_REPLY
+ *  - a frame still incomplete CMD_TIMEOUT_US after its last byte is
+ *    dropped, and CMD_SYNC where the id belongs starts over, so one
+ *    lost byte costs only the frame it was in
+ *
+ * COMMANDS
+ *  - CMD_SET_PARAM   u8 param, s32 value      -> u8 status
+ *  - CMD_MOVE_BLOCK  s16 x, s16 y (center)    -> u8 status
+ *  - CMD_QUERY_STATS (empty)                  -> stats record
+ *  - CMD_TELEMETRY   u16 period ms (0 = off)  -> u8 status, then a
+ *                    stats record every period
+ *  - CMD_BAD_PARAM for an unknown parameter or a block size or
+ *    position off the screen (nothing is changed)
+ *
+ * STATS RECORD (all u32 but spare time, which is s32)
+ *  - number of boids, frames drawn, spare time (us),
+ *    idle time core 0 / core 1 (us), UART characters dropped,
+ *    then bounces, respawns and block hits in the last frame
+ */
+
+#define CMD_SYNC 0xA5
+#define CMD_REPLY 0x80
+#define CMD_MAX_PAYLOAD 48
+// sync, id, len and check around the payload
+#define CMD_MAX_FRAME (CMD_MAX_PAYLOAD + 4)
+#define CMD_TIMEOUT_US 50000
+
+enum cmd_id {CMD_SET_PARAM = 1, CMD_MOVE_BLOCK, CMD_QUERY_STATS, CMD_TELEMETRY} ;
+enum cmd_param {PARAM_NUM_BOIDS, PARAM_BLOCK_LENGTH, PARAM_BLOCK_WIDTH, PARAM_CAPTURE_DECIMATE} ;
+enum cmd_status {CMD_OK, CMD_BAD_LENGTH, CMD_BAD_PARAM, CMD_BAD_ID} ;
+
+struct cmd_frame {
+  unsigned char id ;
+  unsigned char len ;
+  unsigned char payload[CMD_MAX_PAYLOAD] ;
+} ;
+
+struct cmd_parser {
+  unsigned char state ;
+  unsigned char pos ;
+  unsigned char check ;
+  struct cmd_frame frame ;
+  unsigned int last_us ;  // arrival time of the last byte
+  unsigned int errors ;   // frames dropped on a bad length, check or timeout
+} ;
+
+// Parser - feed it one received byte at a time
+void cmd_init(struct cmd_parser * p) ;
+// 1 once p->frame holds a complete, valid frame, otherwise 0
+int cmd_feed(struct cmd_parser * p, unsigned char byte) ;
+// 1 while in the middle of a frame
+int cmd_busy(const struct cmd_parser * p) ;
+// Call with the arrival time of each byte before cmd_busy/cmd_feed,
+// drops a frame that stalled (CMD_TIMEOUT_US)
+void cmd_expire(struct cmd_parser * p, unsigned int now_us) ;
+
+// Build a frame into out (CMD_MAX_FRAME bytes), returns its length
+int cmd_encode(unsigned char * out, unsigned char id, const unsigned char * payload, int len) ;
+
+// Little-endian field access
+static inline int cmd_get16(const unsigned char * b) { return (short)(b[0] | (b[1] << 8)) ; }
+static inline int cmd_get32(const unsigned char * b) { return (int)(b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned int)b[3] << 24)) ; }
+static inline void cmd_put16(unsigned char * b, int v) { b[0] = v ; b[1] = v >> 8 ; }
+static inline void cmd_put32(unsigned char * b, int v) { b[0] = v ; b[1] = v >> 8 ; b[2] = v >> 16 ; b[3] = v >> 24 ; }
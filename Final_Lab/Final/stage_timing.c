@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+// Header file
+#include "stage_timing.h"
+// Rings come from the SRAM arena
+#include "mem_arena.h"
+
+static const char * stage_name[NUM_STAGES] = {"integrate", "collide", "erase", "draw", "hud", "sched"} ;
+
+unsigned int stage_mark[2] ;
+unsigned int stage_acc[2][NUM_STAGES] ;
+
+// per-frame us for each stage, STAGE_RING frames per core
+static unsigned short (* stage_ring[2])[NUM_STAGES] ;
+static unsigned int stage_frames[2] ;
+static unsigned long long stage_last_sched[2] ;
+static unsigned int stage_cyc_per_us ;
+
+void stage_init(void)
+{
+  for (int core = 0; core<2; core++) {
+    stage_ring[core] = arena_alloc(ARENA_MAIN, STAGE_RING*sizeof(*stage_ring[core]), 4, "stage ring") ;
+  }
+  stage_cyc_per_us = clock_get_hz(clk_sys) / 1000000 ;
+}
+
+void stage_init_core(void)
+{
+  // free-running from the processor clock, no interrupt
+  systick_hw->rvr = 0xffffff ;
+  systick_hw->cvr = 0 ;
+  systick_hw->csr = 0x5 ;
+}
+
+void stage_frame_end(unsigned long long sched_us)
+{
+  unsigned int core = get_core_num() ;
+  unsigned short * slot = stage_ring[core][stage_frames[core] % STAGE_RING] ;
+  for (int s = 0; s<NUM_STAGES; s++) {
+    unsigned int us = stage_acc[core][s] / stage_cyc_per_us ;
+    slot[s] = us > 0xffff ? 0xffff : us ;
+    stage_acc[core][s] = 0 ;
+  }
+  unsigned long long sched = sched_us - stage_last_sched[core] ;
+  slot[STAGE_SCHED] = sched > 0xffff ? 0xffff : sched ;
+  stage_last_sched[core] = sched_us ;
+  stage_frames[core]++ ;
+}
+
+int stage_report_line(char * buf, int core, int s)
+{
+  static unsigned short sorted[STAGE_RING] ;
+  if (s >= NUM_STAGES) return 0 ;
+  int n = stage_frames[core] < STAGE_RING ? stage_frames[core] : STAGE_RING ;
+  if (n == 0) {
+    sprintf(buf, "c%d %-9s no frames\n\r", core, stage_name[s]) ;
+    return 1 ;
+  }
+  // insertion sort, the ring is short and this only runs on request
+  unsigned int sum = 0 ;
+  for (int i = 0; i<n; i++) {
+    unsigned short v = stage_ring[core][i][s] ;
+    int j = i ;
+    for (; j>0 && sorted[j-1] > v; j--) sorted[j] = sorted[j-1] ;
+    sorted[j] = v ;
+    sum += v ;
+  }
+  sprintf(buf, "c%d %-9s min:%5u avg:%5u max:%5u p99:%5u us\n\r", core, stage_name[s],
+          sorted[0], sum/n, sorted[n-1], sorted[(n-1)*99/100]) ;
+  return 1 ;
+}
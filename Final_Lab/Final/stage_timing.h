@@ -0,0 +1,55 @@
+/**
+ * Per-stage frame timing
+ *
+ * Hot paths mark stage boundaries with STAGE_START()/STAGE_MARK(),
+ * which read the core's SysTick (run as a free 24-bit cycle counter)
+ * and charge the cycles since the previous mark to a stage. At the end
+ * of each frame STAGE_FRAME_END() moves the per-stage totals into a
+ * ring of the last STAGE_RING frames on that core, together with the
+ * scheduler's own overhead for the frame. stage_report_line() prints
+ * min/avg/max/p99 in us per frame from the ring.
+ *
+ * With STAGE_TIMING 0 the macros compile to nothing.
+ *
+ * NOTE
+ *  - A mark and its STAGE_START() must be in the same thread call
+ *    (no yield in between), SysTick wraps after 2^24 cycles.
+ *  - stage_init() from core 0 before core 1 is launched (it allocates
+ *    from the arena), stage_init_core() on each core.
+ */
+
+#define STAGE_TIMING 0
+// frames kept per core
+#define STAGE_RING 256
+
+enum stage {STAGE_INTEGRATE, STAGE_COLLIDE, STAGE_ERASE, STAGE_DRAW, STAGE_HUD, STAGE_SCHED, NUM_STAGES} ;
+
+#if STAGE_TIMING
+#include "hardware/structs/systick.h"
+
+extern unsigned int stage_mark[2] ;
+extern unsigned int stage_acc[2][NUM_STAGES] ;
+
+// restart the count on this core
+#define STAGE_START() (stage_mark[get_core_num()] = systick_hw->cvr)
+// charge the cycles since the last mark to stage s
+#define STAGE_MARK(s) do { \
+  unsigned int _core = get_core_num() ; \
+  unsigned int _now = systick_hw->cvr ; \
+  stage_acc[_core][s] += (stage_mark[_core] - _now) & 0xffffff ; \
+  stage_mark[_core] = _now ; \
+} while(0)
+// close this core's frame, sched_us is the core's running scheduler overhead
+#define STAGE_FRAME_END(sched_us) stage_frame_end(sched_us)
+#else
+#define STAGE_START()
+#define STAGE_MARK(s)
+#define STAGE_FRAME_END(sched_us)
+#endif
+
+// Stage timing - usable in main
+void stage_init(void) ;
+void stage_init_core(void) ;
+void stage_frame_end(unsigned long long sched_us) ;
+// one line for stage s of a core into buf, 0 past the last stage
+int stage_report_line(char * buf, int core, int s) ;
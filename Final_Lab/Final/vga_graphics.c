@@ -3,6 +3,7 @@
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
 #include "hardware/dma.h"
+#include "hardware/irq.h"
 // Our assembled programs:
 // Each gets the name <pio_filename.pio.h>
 #include "hsync.pio.h"
@@ -10,23 +11,36 @@
 #include "rgb.pio.h"
 // Header file
 #include "vga_graphics.h"
+// Framebuffer comes from the SRAM arena
+#include "mem_arena.h"
 // Font file
 #include "glcdfont.c"
 
 // VGA timing constants
 #define H_ACTIVE   655    // (active + frontporch - 1) - one cycle delay for mov
 #define V_ACTIVE   479    // (active - 1)
-#define RGB_ACTIVE 319    // (horizontal active)/2 - 1
-// #define RGB_ACTIVE 639 // change to this if 1 pixel/byte
 
 // Length of the pixel array, and number of DMA transfers
 #define TXCOUNT 153600 // Total pixels/2 (since we have 2 pixels per byte)
 
 // Pixel color array that is DMA's to the PIO machines and
 // a pointer to the ADDRESS of this color array.
-// Note that this array is automatically initialized to all 0's (black)
-unsigned char vga_data_array[TXCOUNT];
-char * address_pointer = &vga_data_array[0] ;
+// The array is allocated from the SRAM arena in initVGA(), which
+// is zero-initialized like any other .bss (all black)
+unsigned char * vga_data_array ;
+char * address_pointer ;
+// Size of the image held in vga_data_array: 640x480, 320x240 in low
+// resolution mode, or only the text lines in scanline mode
+short vga_width = 640 ;
+short vga_lines = 480 ;
+short vga_line_bytes = 320 ;
+// 1 when each framebuffer pixel covers 2x2 screen pixels
+static short vga_shift = 0 ;
+// Drawing below the screen is clamped to this row (further down when
+// initVGALines adds rows past the bottom)
+static short vga_last_row = 479 ;
+// 1 when the framebuffer holds palette indices (see initVGAIndexed)
+static bool vga_indexed = 0 ;
 
 // Bit masks for drawPixel routine
 #define TOPMASK 0b11000111
@@ -49,9 +63,36 @@ char textcolor, textbgcolor, wrap;
 #define _width 640
 #define _height 480
 
-void initVGA() {
-        // Choose which PIO instance to use (there are two instances, each with 4 state machines)
-    PIO pio = pio0;
+// Choose which PIO instance to use (there are two instances, each with 4 state machines)
+static PIO const pio = pio0;
+// Manually select a few state machines from pio instance pio0.
+static const uint hsync_sm = 0;
+static const uint vsync_sm = 1;
+static const uint rgb_sm = 2;
+// DMA channels - 0 sends color data, 1 reconfigures and restarts 0
+static const int rgb_chan_0 = 0;
+static const int rgb_chan_1 = 1;
+
+// Vertical blank: vsync.pio raises PIO irq flag 2 as the sync pulse
+// starts, which is 34 lines (1088 us) before the first active line
+#define VBLANK_IRQ 2
+#define VBLANK_US  1050
+volatile uint32_t vga_frame_count ;
+static volatile uint32_t vblank_time ;
+
+static void vblankIrq(void) {
+    pio_interrupt_clear(pio, VBLANK_IRQ) ;
+    vblank_time = time_us_32() ;
+    vga_frame_count++ ;
+}
+
+bool inVBlank(void) {
+    return vga_frame_count && time_us_32() - vblank_time < VBLANK_US ;
+}
+
+// Load the three timing programs and set up their state machines,
+// which are started by startTiming
+static void initTiming(void) {
 
     // Our assembled program needs to be loaded into this PIO's instruction
     // memory. This SDK function will find a location (offset) in the
@@ -67,27 +108,66 @@ void initVGA() {
     uint vsync_offset = pio_add_program(pio, &vsync_program);
     uint rgb_offset = pio_add_program(pio, &rgb_program);
 
-    // Manually select a few state machines from pio instance pio0.
-    uint hsync_sm = 0;
-    uint vsync_sm = 1;
-    uint rgb_sm = 2;
-
     // Call the initialization functions that are defined within each PIO file.
     // Why not create these programs here? By putting the initialization function in
     // the pio file, then all information about how to use/setup that state machine
     // is consolidated in one place. Here in the C, we then just import and use it.
     hsync_program_init(pio, hsync_sm, hsync_offset, HSYNC);
     vsync_program_init(pio, vsync_sm, vsync_offset, VSYNC);
-    rgb_program_init(pio, rgb_sm, rgb_offset, RED_PIN);
+    rgb_program_init(pio, rgb_sm, rgb_offset, RED_PIN, 1 << vga_shift);
+}
+
+// Hand the state machines their counters and start them together
+// with the DMA channels in dma_mask
+static void startTiming(uint32_t dma_mask) {
+    // Initialize PIO state machine counters. This passes the information to the state machines
+    // that they retrieve in the first 'pull' instructions, before the .wrap_target directive
+    // in the assembly. Each uses these values to initialize some counting registers.
+    pio_sm_put_blocking(pio, hsync_sm, H_ACTIVE);
+    pio_sm_put_blocking(pio, vsync_sm, V_ACTIVE);
+    pio_sm_put_blocking(pio, rgb_sm, (VGA_LINE_BYTES >> vga_shift) - 1);  // bytes per line - 1
 
+    // Count frames on the vsync machine's irq flag
+    pio_set_irq0_source_enabled(pio, pis_interrupt0 + VBLANK_IRQ, true) ;
+    irq_set_exclusive_handler(PIO0_IRQ_0, vblankIrq) ;
+    irq_set_enabled(PIO0_IRQ_0, true) ;
+
+    // Start the two pio machine IN SYNC
+    // Note that the RGB state machine is running at full speed,
+    // so synchronization doesn't matter for that one. But, we'll
+    // start them all simultaneously anyway.
+    pio_enable_sm_mask_in_sync(pio, ((1u << hsync_sm) | (1u << vsync_sm) | (1u << rgb_sm)));
+
+    // Start the DMA. From here on the color data is continuously
+    // DMA'd to the PIO machines that are driving the screen.
+    dma_start_channel_mask(dma_mask) ;
+}
+
+void initVGA() {
+    initVGAMode(VGA_640x480) ;
+}
+
+static void initLineList(short shift, short extra_rows) ;
+
+void initVGAMode(enum vga_mode mode) {
+    if (mode == VGA_320x240) {
+        initLineList(1, 0) ;
+        return ;
+    }
+
+    // Claim the framebuffer before anything else takes the striped SRAM
+    vga_data_array = arena_alloc(ARENA_MAIN, TXCOUNT, 4, "framebuffer") ;
+    address_pointer = (char *)vga_data_array ;
+
+    initTiming() ;
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////
     // ============================== PIO DMA Channels =================================================
     /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    // DMA channels - 0 sends color data, 1 reconfigures and restarts 0
-    int rgb_chan_0 = 0;
-    int rgb_chan_1 = 1;
+    // claim both so dma_claim_unused_channel() hands out others
+    dma_channel_claim(rgb_chan_0) ;
+    dma_channel_claim(rgb_chan_1) ;
 
     // Channel Zero (sends color data to PIO VGA machine)
     dma_channel_config c0 = dma_channel_get_default_config(rgb_chan_0);  // default configs
@@ -101,7 +181,7 @@ void initVGA() {
         rgb_chan_0,                 // Channel to be configured
         &c0,                        // The configuration we just created
         &pio->txf[rgb_sm],          // write address (RGB PIO TX FIFO)
-        &vga_data_array,            // The initial read address (pixel color array)
+        vga_data_array,             // The initial read address (pixel color array)
         TXCOUNT,                    // Number of transfers; in this case each is 1 byte.
         false                       // Don't start immediately.
     );
@@ -125,25 +205,274 @@ void initVGA() {
     /////////////////////////////////////////////////////////////////////////////////////////////////////
     /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    // Initialize PIO state machine counters. This passes the information to the state machines
-    // that they retrieve in the first 'pull' instructions, before the .wrap_target directive
-    // in the assembly. Each uses these values to initialize some counting registers.
-    pio_sm_put_blocking(pio, hsync_sm, H_ACTIVE);
-    pio_sm_put_blocking(pio, vsync_sm, V_ACTIVE);
-    pio_sm_put_blocking(pio, rgb_sm, RGB_ACTIVE);
-
-
-    // Start the two pio machine IN SYNC
-    // Note that the RGB state machine is running at full speed,
-    // so synchronization doesn't matter for that one. But, we'll
-    // start them all simultaneously anyway.
-    pio_enable_sm_mask_in_sync(pio, ((1u << hsync_sm) | (1u << vsync_sm) | (1u << rgb_sm)));
-
     // Start DMA channel 0. Once started, the contents of the pixel color array
     // will be continously DMA's to the PIO machines that are driving the screen.
     // To change the contents of the screen, we need only change the contents
     // of that array.
-    dma_start_channel_mask((1u << rgb_chan_0)) ;
+    startTiming(1u << rgb_chan_0) ;
+}
+
+
+// ============================== Line list modes ======================================================
+// Channel 1 hands channel 0 the start address of every screen line from
+// line_addr, so any line can show any framebuffer row: rows can be
+// repeated, scrolled or kept off screen with no copying. The list ends
+// in a null address, which stops the chain and raises the interrupt
+// that starts it over during vertical blanking.
+//
+// Low resolution mode: the framebuffer is 320x240, 160 bytes per row.
+// The rgb machine runs at half speed so each pixel is two screen pixels
+// wide, and each row is listed for two screen lines.
+
+// Start address for each of the 480 screen lines, then a null
+static unsigned char ** line_addr ;
+
+// Point lines [line, line+count) at rows [row, row+count)
+void showRows(short line, short count, short row) {
+    for (short i=0; i<count; i++) {
+        short y = line + i ;
+        short r = row + i ;
+        if ((y < 0) || (y >= _height) || (r < 0) || (r >= vga_lines)) continue ;
+        line_addr[y] = &vga_data_array[r * vga_line_bytes] ;
+    }
+}
+
+// Show lines [line, line+count) moved up by offset lines, wrapping
+// around within the band (offset 0 puts them back). Each line starts
+// from the row of its own number, so this replaces any showRows
+// mapping in the band rather than scrolling it.
+void scrollRows(short line, short count, short offset) {
+    if (count <= 0) return ;
+    for (short i=0; i<count; i++) {
+        short src = line + (((i + offset) % count) + count) % count ;
+        showRows(line + i, 1, src >> vga_shift) ;
+    }
+}
+
+static void lineListIrq(void) {
+    dma_hw->ints0 = 1u << rgb_chan_0 ;
+    dma_channel_set_read_addr(rgb_chan_1, line_addr, true) ;
+}
+
+static void initLineList(short shift, short extra_rows) {
+    vga_shift = shift ;
+    vga_width = _width >> shift ;
+    vga_lines = (_height >> shift) + extra_rows ;
+    vga_line_bytes = vga_width >> 1 ;
+    vga_last_row = (vga_lines << shift) - 1 ;
+    vga_data_array = arena_alloc(ARENA_MAIN, vga_lines * vga_line_bytes, 4, "framebuffer") ;
+    line_addr = arena_alloc(ARENA_MAIN, (_height + 1) * sizeof(unsigned char *), 4, "line list") ;
+    scrollRows(0, _height, 0) ;
+    line_addr[_height] = NULL ;
+
+    initTiming() ;
+
+    dma_channel_claim(rgb_chan_0) ;
+    dma_channel_claim(rgb_chan_1) ;
+
+    // Channel Zero sends one row, then lets channel 1 load the next.
+    // The null written to its trigger at the end of the list raises
+    // channel 0's interrupt; quiet, it raises no other.
+    dma_channel_config c0 = dma_channel_get_default_config(rgb_chan_0);
+    channel_config_set_transfer_data_size(&c0, DMA_SIZE_8);
+    channel_config_set_read_increment(&c0, true);
+    channel_config_set_write_increment(&c0, false);
+    channel_config_set_dreq(&c0, DREQ_PIO0_TX2) ;
+    channel_config_set_chain_to(&c0, rgb_chan_1);
+    channel_config_set_irq_quiet(&c0, true);
+
+    dma_channel_configure(
+        rgb_chan_0,                 // Channel to be configured
+        &c0,                        // The configuration we just created
+        &pio->txf[rgb_sm],          // write address (RGB PIO TX FIFO)
+        vga_data_array,             // set by channel 1
+        vga_line_bytes,             // one row
+        false                       // Don't start immediately.
+    );
+
+    // Channel One writes the next line address to channel 0's read
+    // address trigger
+    dma_channel_config c1 = dma_channel_get_default_config(rgb_chan_1);
+    channel_config_set_transfer_data_size(&c1, DMA_SIZE_32);
+    channel_config_set_read_increment(&c1, true);
+    channel_config_set_write_increment(&c1, false);
+
+    dma_channel_configure(
+        rgb_chan_1,                                 // Channel to be configured
+        &c1,                                        // The configuration we just created
+        &dma_hw->ch[rgb_chan_0].al3_read_addr_trig, // Write address (channel 0 read address + trigger)
+        line_addr,                                  // Read address (the line list)
+        1,                                          // One address each time channel 0 finishes
+        false                                       // Don't start immediately.
+    );
+
+    dma_channel_set_irq0_enabled(rgb_chan_0, true) ;
+    irq_set_exclusive_handler(DMA_IRQ_0, lineListIrq) ;
+    irq_set_enabled(DMA_IRQ_0, true) ;
+
+    startTiming(1u << rgb_chan_1) ;
+}
+
+// 640x480 from a line list, with extra_rows more framebuffer rows below
+// the screen (drawn at y = 480 and up) for showRows to bring into view
+void initVGALines(short extra_rows) {
+    initLineList(0, extra_rows) ;
+}
+
+
+// ============================== Scanline mode =========================================================
+// Only the top text_lines of the screen are kept in vga_data_array. Each
+// line is built just before it goes out, in one of two line buffers: the
+// DMA interrupt at the end of line y starts line y+1 (already built) and
+// builds line y+2 in the buffer line y came from. A line starts as a copy
+// of the framebuffer row (or black below it) and the render callback
+// draws the rest, so it must be done within one line (32 us). The
+// interrupt path runs from RAM, where a flash cache miss (core 1 runs
+// from flash too) cannot stretch it; the callback should as well.
+// Indexed color mode goes out the same way (see below).
+
+// Ping-pong line buffers, line y is built in line_buf[y & 1]
+static unsigned char * line_buf[2] ;
+static vga_line_fn line_render ;
+// Line being sent
+static short scan_y ;
+
+static void __time_critical_func(expandLine)(short y, unsigned char * out) ;
+
+static void __time_critical_func(buildLine)(short y) {
+    uint32_t * dst = (uint32_t *)line_buf[y & 1] ;
+    if (vga_indexed) {
+        expandLine(y, line_buf[y & 1]) ;
+        return ;
+    }
+    if (y < vga_lines) {
+        const uint32_t * src = (const uint32_t *)&vga_data_array[y * VGA_LINE_BYTES] ;
+        for (int i=0; i<(VGA_LINE_BYTES>>2); i++) dst[i] = src[i] ;
+    }
+    else {
+        for (int i=0; i<(VGA_LINE_BYTES>>2); i++) dst[i] = 0 ;
+    }
+    line_render(y, line_buf[y & 1]) ;
+}
+
+static void __time_critical_func(scanlineIrq)(void) {
+    dma_hw->ints0 = 1u << rgb_chan_0 ;
+    scan_y = (scan_y == _height-1) ? 0 : scan_y+1 ;
+    dma_channel_transfer_from_buffer_now(rgb_chan_0, line_buf[scan_y & 1], VGA_LINE_BYTES) ;
+    buildLine((scan_y == _height-1) ? 0 : scan_y+1) ;
+}
+
+// Build lines 0 and 1 and start sending lines from the interrupt
+static void startLines(void) {
+    // only the DMA interrupt (on the core that starts the display,
+    // core 0) touches them, and in SRAM5 the DMA reads of one don't
+    // contend with the striped banks
+    line_buf[0] = arena_alloc(ARENA_SCRATCH_Y, VGA_LINE_BYTES, 4, "line buffer 0") ;
+    line_buf[1] = arena_alloc(ARENA_SCRATCH_Y, VGA_LINE_BYTES, 4, "line buffer 1") ;
+
+    initTiming() ;
+
+    // Channel Zero sends one line, then interrupts for the next
+    dma_channel_claim(rgb_chan_0) ;
+    dma_channel_config c0 = dma_channel_get_default_config(rgb_chan_0);
+    channel_config_set_transfer_data_size(&c0, DMA_SIZE_8);
+    channel_config_set_read_increment(&c0, true);
+    channel_config_set_write_increment(&c0, false);
+    channel_config_set_dreq(&c0, DREQ_PIO0_TX2) ;
+
+    scan_y = 0 ;
+    buildLine(0) ;
+    buildLine(1) ;
+    dma_channel_configure(
+        rgb_chan_0,                 // Channel to be configured
+        &c0,                        // The configuration we just created
+        &pio->txf[rgb_sm],          // write address (RGB PIO TX FIFO)
+        line_buf[0],                // line 0
+        VGA_LINE_BYTES,             // one line
+        false                       // Don't start immediately.
+    );
+
+    // a late line is drawn shifted, so nothing else should hold this off
+    dma_channel_set_irq0_enabled(rgb_chan_0, true) ;
+    irq_set_exclusive_handler(DMA_IRQ_0, scanlineIrq) ;
+    irq_set_priority(DMA_IRQ_0, PICO_HIGHEST_IRQ_PRIORITY) ;
+    irq_set_enabled(DMA_IRQ_0, true) ;
+
+    startTiming(1u << rgb_chan_0) ;
+}
+
+void initVGAScanline(short text_lines, vga_line_fn render) {
+    vga_lines = text_lines ;
+    vga_data_array = arena_alloc(ARENA_MAIN, text_lines * VGA_LINE_BYTES, 4, "text lines") ;
+    line_render = render ;
+    startLines() ;
+}
+
+
+// ============================== Indexed color mode ====================================================
+// vga_data_array holds a 2-bit palette index per pixel, four pixels per
+// byte (pixel x in bits 2*(x&3)+1:2*(x&3)), half the size of the 3-bit
+// image. The rgb machine can only shift bits out to the pins, so the
+// lines go out through the scanline interrupt, which expands each row
+// with one table lookup per byte: four indices in, two bytes of 3-bit
+// pixels out. That is a few microseconds of every 32 us line.
+
+// The four colors shown for the indices
+static char vga_palette[4] ;
+// Byte of four indices -> the two framebuffer bytes they show as
+static uint16_t palette_lut[256] ;
+// Index drawn for each of the 8 colors: the palette entry nearest to it
+static unsigned char color_index[8] ;
+
+static void __time_critical_func(expandLine)(short y, unsigned char * out) {
+    const unsigned char * src = &vga_data_array[y * vga_line_bytes] ;
+    uint16_t * dst = (uint16_t *)out ;
+    for (int i=0; i<vga_line_bytes; i++) {
+        dst[i] = palette_lut[src[i]] ;
+    }
+}
+
+void setPalette(unsigned char index, char color) {
+    vga_palette[index & 3] = color & 7 ;
+    for (int b=0; b<256; b++) {
+        char c0 = vga_palette[b & 3] ;
+        char c1 = vga_palette[(b >> 2) & 3] ;
+        char c2 = vga_palette[(b >> 4) & 3] ;
+        char c3 = vga_palette[(b >> 6) & 3] ;
+        palette_lut[b] = (c0 | (c1 << 3)) | ((c2 | (c3 << 3)) << 8) ;
+    }
+    // nearest by number of differing color bits, ties to the lower index
+    for (int c=0; c<8; c++) {
+        int best = 0, best_bits = 4 ;
+        for (int i=0; i<4; i++) {
+            int bits = __builtin_popcount(c ^ vga_palette[i]) ;
+            if (bits < best_bits) {
+                best = i ;
+                best_bits = bits ;
+            }
+        }
+        color_index[c] = best ;
+    }
+}
+
+void initVGAIndexed(const char palette[4]) {
+    vga_indexed = 1 ;
+    vga_line_bytes = _width >> 2 ;
+    vga_data_array = arena_alloc(ARENA_MAIN, _height * vga_line_bytes, 4, "framebuffer") ;
+    for (int i=0; i<4; i++) {
+        setPalette(i, palette[i]) ;
+    }
+    startLines() ;
+}
+
+// Row y as shown, 3-bit pixels two per byte: the framebuffer row itself,
+// or in indexed mode the row expanded into out (VGA_LINE_BYTES)
+const unsigned char * getLine(short y, unsigned char * out) {
+    if (vga_indexed) {
+        expandLine(y, out) ;
+        return out ;
+    }
+    return &vga_data_array[y * vga_line_bytes] ;
 }
 
 
@@ -156,10 +485,22 @@ void drawPixel(short x, short y, char color) {
     if (x > 639) x = 639 ;
     if (x < 0) x = 0 ;
     if (y < 0) y = 0 ;
-    if (y > 479) y = 479 ;
+    if (y > vga_last_row) y = vga_last_row ;
+    if (y >= (vga_lines << vga_shift)) return ;
+
+    // In low resolution mode a pixel covers 2x2 screen pixels
+    x >>= vga_shift ;
+    y >>= vga_shift ;
 
     // Which pixel is it?
-    int pixel = ((640 * y) + x) ;
+    int pixel = ((vga_width * y) + x) ;
+
+    // In indexed mode four pixels share a byte
+    if (vga_indexed) {
+        int shift = (pixel & 3) << 1 ;
+        vga_data_array[pixel>>2] = (vga_data_array[pixel>>2] & ~(3 << shift)) | (color_index[color & 7] << shift) ;
+        return ;
+    }
 
     // Is this pixel stored in the first 3 bits
     // of the vga data array index, or the second
@@ -446,11 +787,62 @@ void fillRect(short x, short y, short w, short h, char color) {
   }
 }
 
+// fill a rectangle a byte (two pixels) at a time
+void fillRectAligned(short x, short y, short w, short h, char color) {
+/* Same as fillRect, but x and w must be even so that every byte of
+ * the rectangle holds two of its pixels. Clipped to the screen.
+ * Parameters:
+ *      x:  even x-coordinate of top-left vertex
+ *      y:  y-coordinate of top-left vertex
+ *      w:  even width of rectangle
+ *      h:  height of rectangle
+ *      color:  3-bit color value
+ * Returns:     Nothing
+ */
+  if (x < 0) { w += x ; x = 0 ; }
+  if (y < 0) { h += y ; y = 0 ; }
+  if ((x + w) > _width)  w = _width - x ;
+  if ((y + h) > (vga_lines << vga_shift)) h = (vga_lines << vga_shift) - y ;
+  if ((w <= 0) || (h <= 0)) return ;
+
+  if (vga_shift) {
+    // a low resolution pixel covers two columns, so bytes don't line up
+    for (short j=(y & ~1); j<(y+h); j+=2) {
+      for (short i=x; i<(x+w); i+=2) {
+        drawPixel(i, j, color) ;
+      }
+    }
+    return ;
+  }
+
+  if (vga_indexed) {
+    // whole bytes of four pixels in the middle, single pixels at the ends
+    unsigned char quad = color_index[color & 7] * 0x55 ;
+    for (short j=y; j<(y+h); j++) {
+      short i = x ;
+      for ( ; (i < (x+w)) && (i & 3); i++) drawPixel(i, j, color) ;
+      unsigned char * b = &vga_data_array[((_width * j) + i)>>2] ;
+      for ( ; (i + 4) <= (x+w); i += 4) *b++ = quad ;
+      for ( ; i < (x+w); i++) drawPixel(i, j, color) ;
+    }
+    return ;
+  }
+
+  unsigned char pair = (color << 3) | color ;
+  unsigned char * row = &vga_data_array[((_width * y) + x)>>1] ;
+  for (short j=0; j<h; j++) {
+    for (short i=0; i<(w>>1); i++) {
+      row[i] = pair ;
+    }
+    row += (_width>>1) ;
+  }
+}
+
 // Draw a character
 void drawChar(short x, short y, unsigned char c, char color, char bg, unsigned char size) {
     char i, j;
   if((x >= _width)            || // Clip right
-     (y >= _height)           || // Clip bottom
+     (y > vga_last_row)       || // Clip bottom
      ((x + 6 * size - 1) < 0) || // Clip left
      ((y + 8 * size - 1) < 0))   // Clip top
     return;
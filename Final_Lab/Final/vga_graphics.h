@@ -14,6 +14,20 @@
  *  - PIO state machines 0, 1, and 2 on PIO instance 0
  *  - DMA channels 0, 1, 2, and 3
  *  - 153.6 kBytes of RAM (for pixel color data)
+ *  - PIO irq flag 2 and PIO0_IRQ_0 on the core that starts it, for
+ *    the frame counter
+ *
+ * LINE LIST MODES (initVGAMode(VGA_320x240), initVGALines)
+ *  - DMA channels 0 and 1 and DMA_IRQ_0 on the core that starts it
+ *  - 1.9 kBytes for the line list, plus 38.4 kBytes for a 320x240
+ *    image shown doubled, or 153.6 kBytes and 320 per extra row
+ *
+ * SCANLINE MODE (initVGAScanline)
+ *  - DMA channel 0 and DMA_IRQ_0 on the core that starts it
+ *  - 320 bytes per text line kept, plus two line buffers
+ *
+ * INDEXED COLOR MODE (initVGAIndexed)
+ *  - as scanline mode, with 76.8 kBytes for 2-bit palette indices
  *
  * NOTE
  *  - This is a translation of the display primitives
@@ -21,6 +35,8 @@
  *
  */
 
+#include <stdbool.h>
+#include <stdint.h>
 
 // Give the I/O pins that we're using some names that make sense - usable in main()
 enum vga_pins {HSYNC=16, VSYNC, RED_PIN, GREEN_PIN, BLUE_PIN} ;
@@ -28,8 +44,48 @@ enum vga_pins {HSYNC=16, VSYNC, RED_PIN, GREEN_PIN, BLUE_PIN} ;
 // We can only produce 8 (3-bit) colors, so let's give them readable names - usable in main()
 enum colors {BLACK, RED, GREEN, YELLOW, BLUE, MAGENTA, CYAN, WHITE} ;
 
+// Display modes for initVGAMode - usable in main. Drawing always takes
+// 640x480 coordinates; at 320x240 each pixel covers a 2x2 screen block.
+enum vga_mode {VGA_640x480, VGA_320x240} ;
+
+// The framebuffer, two pixels per byte (four 2-bit palette indices in
+// indexed mode), vga_line_bytes per row and
+// vga_lines rows of vga_width pixels (read-only outside vga_graphics.c,
+// e.g. for capture). VGA_LINE_BYTES is the length of a full resolution
+// line. Drawing below the rows held is dropped.
+#define VGA_LINE_BYTES 320
+extern unsigned char * vga_data_array ;
+extern short vga_width, vga_lines, vga_line_bytes ;
+
+// Scanline mode: called from the DMA interrupt to draw line y into
+// line (VGA_LINE_BYTES, packed like vga_data_array) about one line
+// before it is shown
+typedef void (*vga_line_fn)(short y, unsigned char* line) ;
+
+// Refreshes shown since the display started (counted at the vsync
+// pulse, 59.5 per second), and whether the beam is in the vertical
+// blank, where nothing is shown for about a millisecond. For example
+// PT_YIELD_UNTIL(pt, vga_frame_count != last) waits for the next one.
+extern volatile uint32_t vga_frame_count ;
+bool inVBlank(void) ;
+
 // VGA primitives - usable in main
 void initVGA(void) ;
+void initVGAMode(enum vga_mode mode) ;
+// Line list modes: showRows points screen lines at framebuffer rows
+// (e.g. a HUD drawn in the extra rows, or a row repeated) and
+// scrollRows rotates a band of lines through the rows of the same
+// numbers, undoing any showRows in the band. Changes show as the beam
+// reaches the lines, drawing still goes to framebuffer rows.
+void initVGALines(short extra_rows) ;
+void showRows(short line, short count, short row) ;
+void scrollRows(short line, short count, short offset) ;
+void initVGAScanline(short text_lines, vga_line_fn render) ;
+// Indexed mode: drawing stores the index of the palette color nearest
+// to the one asked for, and setPalette changes what an index shows
+void initVGAIndexed(const char palette[4]) ;
+void setPalette(unsigned char index, char color) ;
+const unsigned char * getLine(short y, unsigned char * out) ;
 void drawPixel(short x, short y, char color) ;
 void drawVLine(short x, short y, short h, char color) ;
 void drawHLine(short x, short y, short w, char color) ;
@@ -42,6 +98,7 @@ void fillCircleHelper(short x0, short y0, short r, unsigned char cornername, sho
 void drawRoundRect(short x, short y, short w, short h, short r, char color) ;
 void fillRoundRect(short x, short y, short w, short h, short r, char color) ;
 void fillRect(short x, short y, short w, short h, char color) ;
+void fillRectAligned(short x, short y, short w, short h, char color) ;
 void drawChar(short x, short y, unsigned char c, char color, char bg, unsigned char size) ;
 void setCursor(short x, short y);
 void setTextColor(char c);
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""
+Rebuild frames from the framebuffer capture stream (see
+Final/frame_capture.h) and write them out as PNG files.
+
+Usage:
+    capture_decode.py /dev/ttyACM0 outdir      (USB serial, needs pyserial)
+    capture_decode.py capture.bin outdir       (a saved stream)
+
+Start the capture with `set capture_decimate N` in replay_cmds.py.
+Frames are written as outdir/frame_NNNNN.png, for a video use e.g.
+    ffmpeg -framerate 10 -i outdir/frame_%05d.png capture.mp4
+Frames are only written once a keyframe has been seen.
+"""
+
+import os
+import struct
+import sys
+import zlib
+
+END = 0xFFFF
+KEYFRAME = 1
+# enum colors: bit 0 red, bit 1 green, bit 2 blue
+PALETTE = [bytes((255 * (c & 1), 255 * ((c >> 1) & 1), 255 * ((c >> 2) & 1))) for c in range(8)]
+
+
+def write_png(path, width, height, fb):
+    rows = bytearray()
+    stride = width // 2
+    for y in range(height):
+        rows.append(0)
+        for b in fb[y * stride:(y + 1) * stride]:
+            rows += PALETTE[b & 7]
+            rows += PALETTE[(b >> 3) & 7]
+
+    def chunk(kind, data):
+        body = kind + data
+        return struct.pack(">I", len(data)) + body + struct.pack(">I", zlib.crc32(body))
+
+    with open(path, "wb") as f:
+        f.write(b"\x89PNG\r\n\x1a\n")
+        f.write(chunk(b"IHDR", struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)))
+        f.write(chunk(b"IDAT", zlib.compress(bytes(rows))))
+        f.write(chunk(b"IEND", b""))
+
+
+class Stream:
+    def __init__(self, src):
+        self.src = src
+
+    def read(self, n):
+        data = b""
+        while len(data) < n:
+            more = self.src.read(n - len(data))
+            if not more and not hasattr(self.src, "in_waiting"):
+                raise EOFError
+            data += more
+        return data
+
+    def sync(self):
+        """Skip to the next frame header, returns its fields."""
+        prev = b""
+        while True:
+            c = self.read(1)
+            if prev == b"V" and c == b"F":
+                seq, width, height, flags = struct.unpack("<HHHB", self.read(7))
+                if 0 < width <= 1024 and 0 < height <= 1024 and width % 2 == 0:
+                    return seq, width, height, flags
+            prev = c
+
+
+def decode(stream, outdir):
+    fb = None
+    have_key = False
+    count = 0
+    while True:
+        seq, width, height, flags = stream.sync()
+        stride = width // 2
+        if fb is None or len(fb) != stride * height:
+            fb = bytearray(stride * height)
+            have_key = False
+        if flags & KEYFRAME:
+            have_key = True
+        ok = True
+        while True:
+            (y,) = struct.unpack("<H", stream.read(2))
+            if y == END:
+                break
+            (n,) = struct.unpack("<H", stream.read(2))
+            rle = stream.read(n)
+            line = bytearray()
+            for i in range(0, n - 1, 2):
+                line += bytes([rle[i + 1]]) * rle[i]
+            if y >= height or len(line) != stride:
+                ok = False
+                break
+            fb[y * stride:(y + 1) * stride] = line
+        if ok and have_key:
+            write_png(os.path.join(outdir, "frame_%05d.png" % count), width, height, fb)
+            print("frame %d (seq %d)" % (count, seq))
+            count += 1
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    os.makedirs(sys.argv[2], exist_ok=True)
+    if os.path.isfile(sys.argv[1]):
+        src = open(sys.argv[1], "rb")
+    else:
+        import serial
+        src = serial.Serial(sys.argv[1], timeout=1)
+    try:
+        decode(Stream(src), sys.argv[2])
+    except EOFError:
+        pass
+
+
+if __name__ == "__main__":
+    main()
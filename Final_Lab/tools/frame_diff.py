@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Compare frames written by capture_decode.py pixel by pixel.
+
+Usage:
+    frame_diff.py golden/frame_00003.png new/frame_00003.png
+    frame_diff.py golden_dir new_dir        (every frame_*.png in both)
+
+For each pair this prints the number of differing pixels, their
+bounding box and the first few of them with both colors. The exit
+status is 1 if any frame differs. Only reads the 8-bit RGB,
+unfiltered PNGs that capture_decode.py writes.
+"""
+
+import os
+import struct
+import sys
+import zlib
+
+SHOW = 8
+NAMES = ["black", "red", "green", "yellow", "blue", "magenta", "cyan", "white"]
+
+
+def read_png(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    pos, idat = 8, b""
+    while pos < len(data):
+        (n,) = struct.unpack(">I", data[pos:pos + 4])
+        kind = data[pos + 4:pos + 8]
+        body = data[pos + 8:pos + 8 + n]
+        if kind == b"IHDR":
+            width, height = struct.unpack(">II", body[:8])
+        elif kind == b"IDAT":
+            idat += body
+        pos += 12 + n
+    raw = zlib.decompress(idat)
+    stride = 1 + 3 * width
+    rows = [raw[y * stride + 1:(y + 1) * stride] for y in range(height)]
+    return width, height, rows
+
+
+def color(px):
+    return NAMES[(px[0] > 127) | ((px[1] > 127) << 1) | ((px[2] > 127) << 2)]
+
+
+def diff(a_path, b_path):
+    wa, ha, a = read_png(a_path)
+    wb, hb, b = read_png(b_path)
+    if (wa, ha) != (wb, hb):
+        print("%s: size %dx%d vs %dx%d" % (b_path, wa, ha, wb, hb))
+        return True
+    found = []
+    box = [wa, ha, -1, -1]
+    for y in range(ha):
+        if a[y] == b[y]:
+            continue
+        for x in range(wa):
+            pa, pb = a[y][3 * x:3 * x + 3], b[y][3 * x:3 * x + 3]
+            if pa != pb:
+                found.append((x, y, pa, pb))
+                box = [min(box[0], x), min(box[1], y), max(box[2], x), max(box[3], y)]
+    if not found:
+        print("%s: identical" % b_path)
+        return False
+    print("%s: %d pixels differ in (%d,%d)-(%d,%d)" % (b_path, len(found), *box))
+    for x, y, pa, pb in found[:SHOW]:
+        print("  (%d,%d) %s -> %s" % (x, y, color(pa), color(pb)))
+    return True
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    a, b = sys.argv[1], sys.argv[2]
+    if os.path.isdir(a):
+        names = sorted(n for n in os.listdir(a) if n.startswith("frame_") and n.endswith(".png"))
+        pairs = [(os.path.join(a, n), os.path.join(b, n)) for n in names]
+    else:
+        pairs = [(a, b)]
+    differ = False
+    for pa, pb in pairs:
+        if not os.path.exists(pb):
+            print("%s: missing" % pb)
+            differ = True
+            continue
+        differ |= diff(pa, pb)
+    sys.exit(1 if differ else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""
+Replay a command script to the particle system over its serial port,
+using the binary frames described in Final/serial_cmd.h.
+
+Script lines (# starts a comment):
+    set num_boids 5000        set a parameter (num_boids, block_length,
+                              block_width, capture_decimate)
+    move 320 200              move the block's center to (x, y)
+    stats                     query and print one stats record
+    telemetry 500             stream stats every 500 ms (0 stops it)
+    sleep 1.5                 wait, printing any telemetry that arrives
+
+Usage:
+    replay_cmds.py script.txt /dev/ttyUSB0 [baud]
+    replay_cmds.py script.txt -               (write the frames to stdout)
+
+Talking to a port needs pyserial.
+"""
+
+import struct
+import sys
+import time
+
+SYNC = 0xA5
+REPLY = 0x80
+CMD_SET_PARAM, CMD_MOVE_BLOCK, CMD_QUERY_STATS, CMD_TELEMETRY = 1, 2, 3, 4
+PARAMS = {"num_boids": 0, "block_length": 1, "block_width": 2, "capture_decimate": 3}
+STATUS = ["ok", "bad length", "bad param", "bad id"]
+STATS = struct.Struct("<IIiIIIIII")
+STATS_NAMES = ("boids", "frames", "spare_us", "idle0_us", "idle1_us", "rx_dropped",
+               "bounces", "respawns", "block_hits")
+
+
+def encode(cmd_id, payload=b""):
+    check = cmd_id ^ len(payload)
+    for b in payload:
+        check ^= b
+    return bytes([SYNC, cmd_id, len(payload)]) + payload + bytes([check])
+
+
+def parse_line(line):
+    """Return (frame, seconds to sleep) for one script line."""
+    words = line.split("#", 1)[0].split()
+    if not words:
+        return None, 0
+    op, args = words[0], words[1:]
+    if op == "set":
+        return encode(CMD_SET_PARAM, struct.pack("<Bi", PARAMS[args[0]], int(args[1]))), 0
+    if op == "move":
+        return encode(CMD_MOVE_BLOCK, struct.pack("<hh", int(args[0]), int(args[1]))), 0
+    if op == "stats":
+        return encode(CMD_QUERY_STATS), 0
+    if op == "telemetry":
+        return encode(CMD_TELEMETRY, struct.pack("<H", int(args[0]))), 0
+    if op == "sleep":
+        return None, float(args[0])
+    raise ValueError("unknown command: " + op)
+
+
+class Reader:
+    """Pull reply frames out of the byte stream, skipping typed text."""
+
+    def __init__(self, port):
+        self.port = port
+        self.buf = bytearray()
+
+    def poll(self):
+        self.buf += self.port.read(self.port.in_waiting or 1)
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                self.buf.clear()
+                return
+            del self.buf[:start]
+            if len(self.buf) < 3 or len(self.buf) < 4 + self.buf[2]:
+                return
+            cmd_id, n = self.buf[1], self.buf[2]
+            payload = bytes(self.buf[3:3 + n])
+            check = cmd_id ^ n
+            for b in payload:
+                check ^= b
+            if check != self.buf[3 + n]:
+                del self.buf[:1]
+                continue
+            del self.buf[:4 + n]
+            show(cmd_id, payload)
+
+
+def show(cmd_id, payload):
+    if len(payload) == STATS.size:
+        fields = STATS.unpack(payload)
+        print(" ".join("%s=%d" % f for f in zip(STATS_NAMES, fields)))
+    elif len(payload) == 1:
+        status = payload[0]
+        name = STATUS[status] if status < len(STATUS) else str(status)
+        print("reply to %d: %s" % (cmd_id & ~REPLY, name))
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    with open(sys.argv[1]) as f:
+        lines = f.readlines()
+
+    if sys.argv[2] == "-":
+        for line in lines:
+            frame, _ = parse_line(line)
+            if frame:
+                sys.stdout.buffer.write(frame)
+        return
+
+    import serial
+    baud = int(sys.argv[3]) if len(sys.argv) > 3 else 115200
+    port = serial.Serial(sys.argv[2], baud, timeout=0.05)
+    reader = Reader(port)
+    for line in lines:
+        frame, wait = parse_line(line)
+        if frame:
+            port.write(frame)
+            wait = 0.2
+        until = time.time() + wait
+        while time.time() < until:
+            reader.poll()
+
+
+if __name__ == "__main__":
+    main()
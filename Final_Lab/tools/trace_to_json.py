@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""
+Turn an event trace dump (the 'e' key, see Final/event_trace.h) into
+Chrome trace JSON, for chrome://tracing or ui.perfetto.dev.
+
+Usage:
+    trace_to_json.py serial_log.txt trace.json
+
+The log may hold other serial output, only the last block between
+"trace begin" and "trace end" is used. Each core is a process with
+three tracks: the protothread calls, its frames, and its barrier
+waits. Serial DMA starts are instant events on the thread track.
+"""
+
+import json
+import sys
+
+THREAD_ENTER, THREAD_EXIT, FRAME_BEGIN, FRAME_END, WAIT_BEGIN, WAIT_END, DMA_START = range(7)
+TRACK_THREADS, TRACK_FRAMES, TRACK_WAITS = 0, 1, 2
+TRACK_NAMES = {TRACK_THREADS: "threads", TRACK_FRAMES: "frames", TRACK_WAITS: "barrier waits"}
+
+
+def last_block(lines):
+    block, inside = [], False
+    for line in lines:
+        line = line.strip()
+        if line == "trace begin":
+            block, inside = [], True
+        elif line == "trace end":
+            inside = False
+        elif inside and line:
+            block.append(line)
+    return block
+
+
+def convert(block):
+    names = {}
+    events = []
+    last_t = {}
+    wraps = {}
+    open_wait = {}
+    for line in block:
+        words = line.split()
+        if words[0] == "thread":
+            names[(int(words[1]), int(words[2]))] = " ".join(words[3:]).replace("protothread_", "")
+            continue
+        if words[0] != "ev":
+            continue
+        core, kind, arg, t = (int(w) for w in words[1:5])
+        # the device time is 32 bits of us, unwrap it per core
+        if core in last_t and t < last_t[core]:
+            wraps[core] = wraps.get(core, 0) + 1
+        last_t[core] = t
+        ts = t + (wraps.get(core, 0) << 32)
+        ev = {"pid": core, "ts": ts}
+        if kind in (THREAD_ENTER, THREAD_EXIT):
+            ev.update(tid=TRACK_THREADS, ph="B" if kind == THREAD_ENTER else "E",
+                      name=names.get((core, arg), "thread %d" % arg))
+        elif kind in (FRAME_BEGIN, FRAME_END):
+            ev.update(tid=TRACK_FRAMES, ph="B" if kind == FRAME_BEGIN else "E",
+                      name="frame", args={"frame": arg})
+        elif kind == WAIT_BEGIN:
+            open_wait[core] = arg
+            ev.update(tid=TRACK_WAITS, ph="B", name="wait %d" % arg)
+        elif kind == WAIT_END:
+            ev.update(tid=TRACK_WAITS, ph="E", name="wait %d" % open_wait.pop(core, arg))
+        elif kind == DMA_START:
+            ev.update(tid=TRACK_THREADS, ph="i", s="t", name="serial DMA", args={"channel": arg})
+        else:
+            continue
+        events.append(ev)
+
+    # the rings start at different times, so drop unmatched ends
+    events.sort(key=lambda e: e["ts"])
+    depth = {}
+    kept = []
+    for ev in events:
+        key = (ev["pid"], ev["tid"])
+        if ev["ph"] == "B":
+            depth[key] = depth.get(key, 0) + 1
+        elif ev["ph"] == "E":
+            if depth.get(key, 0) == 0:
+                continue
+            depth[key] -= 1
+        kept.append(ev)
+
+    meta = []
+    for core in sorted({e["pid"] for e in kept}):
+        meta.append({"pid": core, "ph": "M", "name": "process_name", "args": {"name": "core %d" % core}})
+        for tid, name in TRACK_NAMES.items():
+            meta.append({"pid": core, "tid": tid, "ph": "M", "name": "thread_name", "args": {"name": name}})
+    return {"traceEvents": meta + kept, "displayTimeUnit": "ms"}
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    with open(sys.argv[1], errors="replace") as f:
+        block = last_block(f.read().replace("\r", "\n").splitlines())
+    if not block:
+        sys.exit("no trace found in " + sys.argv[1])
+    with open(sys.argv[2], "w") as f:
+        json.dump(convert(block), f)
+
+
+if __name__ == "__main__":
+    main()